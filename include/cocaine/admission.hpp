@@ -0,0 +1,127 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+
+#ifndef COCAINE_ADMISSION_HPP
+#define COCAINE_ADMISSION_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/atomic.hpp"
+#include "cocaine/json.hpp"
+
+namespace cocaine { namespace engine {
+
+// NOTE: The bucket is implemented as a Generic Cell Rate Algorithm, so that its
+// whole state fits into a single atomic word: the theoretical arrival time of the
+// next request. This way concurrent drivers can consume tokens without locking.
+
+class token_bucket_t:
+    public boost::noncopyable
+{
+    public:
+        token_bucket_t(double rate,
+                       double burst);
+
+        bool
+        consume();
+
+        // NOTE: Gives back a token taken by a successful consume() for a request
+        // which has been rejected afterwards for some other reason.
+        void
+        refund();
+
+    public:
+        uint64_t
+        admitted() const {
+            return m_admitted;
+        }
+
+        uint64_t
+        rejected() const {
+            return m_rejected;
+        }
+
+    private:
+        // Nanoseconds per token.
+        const int64_t m_interval;
+
+        // Nanoseconds of burst tolerance.
+        const int64_t m_tolerance;
+
+        // Theoretical arrival time, in nanoseconds.
+        std::atomic<int64_t> m_tat;
+
+        // Statistics.
+        std::atomic<uint64_t> m_admitted;
+        std::atomic<uint64_t> m_rejected;
+};
+
+class admission_t:
+    public boost::noncopyable
+{
+    public:
+        admission_t(const Json::Value& args);
+
+        // NOTE: Tokens are only taken if the event conforms to all the buckets it
+        // belongs to, so that a rejection by one bucket doesn't drain another.
+        bool
+        admit(const api::event_t& event);
+
+        // Returns the tokens taken for an admitted event which has been rejected
+        // later on, e.g. because the queue is full.
+        void
+        refund(const api::event_t& event);
+
+        Json::Value
+        info() const;
+
+    private:
+        token_bucket_t *
+        driver(const api::event_t& event) const;
+
+        token_bucket_t *
+        client(const api::event_t& event) const;
+
+    private:
+#if BOOST_VERSION >= 103600
+        typedef boost::unordered_map<
+#else
+        typedef std::map<
+#endif
+            std::string,
+            boost::shared_ptr<token_bucket_t>
+        > bucket_map_t;
+
+        // NOTE: Driver buckets are configured once and never modified afterwards,
+        // so the map itself can be safely read from multiple threads.
+        bucket_map_t m_drivers;
+
+        typedef std::vector<
+            boost::shared_ptr<token_bucket_t>
+        > bucket_list_t;
+
+        // NOTE: Client identities are hashed into a fixed number of buckets, which
+        // bounds the memory usage at the cost of rare collisions.
+        bucket_list_t m_clients;
+};
+
+}} // namespace cocaine::engine
+
+#endif
@@ -22,6 +22,7 @@
 #define COCAINE_EVENT_API_HPP
 
 #include "cocaine/common.hpp"
+#include "cocaine/symbol.hpp"
 
 namespace cocaine { namespace api {
 
@@ -56,12 +57,28 @@ struct event_t {
         policy(policy_)
     { }
 
+    event_t(const std::string& type_,
+            policy_t policy_,
+            const std::string& source_,
+            const std::string& identity_ = std::string()):
+        type(type_),
+        policy(policy_),
+        source(source_),
+        identity(identity_)
+    { }
+
 public:
-    // Event type.
-    const std::string type;
+    // Event type, interned so that the copies are cheap.
+    const symbol_t type;
     
     // Event execution policy.
     const policy_t policy;
+
+    // Originating driver name, as declared in the app manifest.
+    const std::string source;
+
+    // Optional caller identity, e.g. a client address.
+    const std::string identity;
 };
 
 }} // namespace cocaine::api
@@ -42,6 +42,14 @@ struct handle_t:
     virtual
     void
     terminate() = 0;
+
+    // Returns the resident set size of the isolated process in bytes, or
+    // zero if it cannot be determined.
+    virtual
+    size_t
+    resident() const {
+        return 0;
+    }
 };
 
 class isolate_t:
@@ -23,6 +23,8 @@
 
 #include "cocaine/common.hpp"
 
+#include <boost/function.hpp>
+
 namespace cocaine { namespace api {
 
 struct stream_t {
@@ -44,6 +46,30 @@ struct stream_t {
     virtual
     void
     close() = 0;
+
+    // NOTE: Tells the producer on the other side of the stream that nobody is
+    // interested in the results anymore, so that it could stop working.
+    virtual
+    void
+    cancel() {
+        // Empty.
+    }
+
+    // NOTE: Flow control. Pushing into a stream never blocks, but the producer
+    // which cares not to overwhelm the consumer should stop once the stream is
+    // no longer writable, and resume when notified. The callback might be invoked
+    // from any thread, so it should only schedule the actual work.
+    virtual
+    bool
+    writable() {
+        return true;
+    }
+
+    virtual
+    void
+    notify(const boost::function<void()>& callback) {
+        callback();
+    }
 };
 
 struct null_stream_t:
@@ -21,9 +21,11 @@
 #ifndef COCAINE_APP_HPP
 #define COCAINE_APP_HPP
 
+#include "cocaine/atomic.hpp"
 #include "cocaine/common.hpp"
 #include "cocaine/json.hpp"
 
+#include <boost/function.hpp>
 #include <boost/thread/thread.hpp>
 
 namespace cocaine {
@@ -42,6 +44,24 @@ class app_t {
         void
         stop();
 
+        // NOTE: Initiates the graceful shutdown, which finishes the queued
+        // sessions first. The app should still be stopped after it's drained.
+        void
+        drain();
+
+        bool
+        drained() const;
+
+        // NOTE: Redeploys the app and switches the running engine over to the
+        // new version and profile without dropping any sessions.
+        void
+        upgrade(const std::string& profile);
+
+        // NOTE: Reloads the profile and applies it to the running engine. The
+        // slaves are only restarted if the isolate settings have changed.
+        void
+        reload(const std::string& profile);
+
         Json::Value
         info() const;
         
@@ -52,7 +72,18 @@ class app_t {
                 const boost::shared_ptr<api::stream_t>& upstream,
                 engine::mode mode = engine::mode::normal);
 
+        void
+        enqueue_async(const api::event_t& event,
+                      const boost::shared_ptr<api::stream_t>& upstream,
+                      const boost::function<void(const boost::shared_ptr<api::stream_t>&)>& callback);
+
+        std::vector<boost::shared_ptr<api::stream_t>>
+        enqueue_batch(const std::vector<std::pair<api::event_t, boost::shared_ptr<api::stream_t>>>& batch);
+
     private:
+        void
+        run();
+
         void
         deploy(const std::string& name,
                const std::string& path);
@@ -61,11 +92,6 @@ class app_t {
         context_t& m_context;
         std::unique_ptr<logging::log_t> m_log;
 
-        // Configuration
-
-        std::unique_ptr<const manifest_t> m_manifest;
-        std::unique_ptr<const profile_t> m_profile;
-
         // I/O
 
         std::unique_ptr<io::unique_channel_t> m_control;
@@ -75,6 +101,10 @@ class app_t {
         std::unique_ptr<engine::engine_t> m_engine;
         std::unique_ptr<boost::thread> m_thread;
 
+        // NOTE: Cleared by the engine thread once the engine event loop exits,
+        // either after a termination request or after the engine was drained.
+        std::atomic<bool> m_running;
+
         // Event drivers
 
 #if BOOST_VERSION >= 103600
@@ -0,0 +1,215 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_COALESCING_HPP
+#define COCAINE_COALESCING_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/atomic.hpp"
+#include "cocaine/json.hpp"
+
+#include "cocaine/api/event.hpp"
+#include "cocaine/api/stream.hpp"
+
+#include <deque>
+#include <set>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: The upstream of a coalesced session, which fans its results out to all
+// the clients which have sent the identical request while it was in flight. The
+// results are logged, so that the late subscribers could catch up. The clients
+// are never called with the flight or the coalescer lock held, instead each one
+// has its own position in the log, so that the results are delivered in order
+// no matter which thread delivers them.
+
+class flight_t:
+    public api::stream_t
+{
+    public:
+        flight_t(const boost::shared_ptr<coalescer_t>& coalescer,
+                 const boost::shared_ptr<handle_t>& handle,
+                 const std::string& key);
+
+        virtual
+        void
+        push(const char * chunk,
+             size_t size);
+
+        virtual
+        void
+        error(error_code code,
+              const std::string& message);
+
+        virtual
+        void
+        close();
+
+    public:
+        // NOTE: Binds the leader session once it has been submitted. If every
+        // subscriber has already left by then, the session is cancelled right
+        // away.
+        void
+        bind(const boost::shared_ptr<session_t>& session);
+
+        // NOTE: Returns false if the flight has already landed. The results so far
+        // are not delivered to the new subscriber until it catches up.
+        bool
+        subscribe(const boost::shared_ptr<api::stream_t>& upstream);
+
+        void
+        catch_up(const boost::shared_ptr<api::stream_t>& upstream);
+
+        // NOTE: The session is cancelled when its last subscriber leaves.
+        void
+        unsubscribe(const boost::shared_ptr<api::stream_t>& upstream);
+
+    private:
+        struct subscriber_t {
+            subscriber_t(const boost::shared_ptr<api::stream_t>& upstream_):
+                upstream(upstream_),
+                cursor(0),
+                done(false)
+            { }
+
+            const boost::shared_ptr<api::stream_t> upstream;
+
+            // NOTE: Serializes the deliveries to this subscriber only. The number of
+            // the logged chunks delivered so far, and whether the stream is over.
+            boost::mutex mutex;
+            size_t cursor;
+            bool done;
+        };
+
+        typedef std::vector<
+            boost::shared_ptr<subscriber_t>
+        > subscriber_list_t;
+
+        // Delivers whatever the subscriber hasn't seen yet. Returns false if the
+        // subscriber has failed.
+        bool
+        deliver(subscriber_t& subscriber);
+
+        // Delivers to every subscriber and drops the failed ones. Returns false if
+        // there are no subscribers left.
+        bool
+        broadcast();
+
+        void
+        land();
+
+        void
+        cancel(const boost::shared_ptr<session_t>& session);
+
+    private:
+        // NOTE: The flight might outlive both the engine and its coalescer, as long
+        // as some client holds on to its subscription.
+        const boost::weak_ptr<coalescer_t> m_coalescer;
+        const boost::shared_ptr<handle_t> m_handle;
+
+        const std::string m_key;
+
+        // The leader session, guarded by the flight lock.
+        boost::weak_ptr<session_t> m_session;
+
+        subscriber_list_t m_subscribers;
+
+        // NOTE: The references to the logged chunks stay valid as the log grows,
+        // so they're delivered without holding the flight lock.
+        std::deque<std::string> m_log;
+
+        enum class result_t: int {
+            none,
+            error,
+            close
+        };
+
+        result_t m_result;
+        error_code m_code;
+        std::string m_message;
+
+        boost::mutex m_mutex;
+        bool m_landed;
+};
+
+class coalescer_t:
+    public boost::noncopyable,
+    public boost::enable_shared_from_this<coalescer_t>
+{
+    public:
+        coalescer_t(const boost::shared_ptr<handle_t>& handle,
+                    const Json::Value& args);
+
+        // NOTE: Thread-safe, as the configuration is never modified.
+        bool
+        eligible(const api::event_t& event) const;
+
+        // NOTE: The SHA-256 digest of the event type and the request chunks, so
+        // that the keys of the large requests are as cheap to store and compare
+        // as any other, both here and in the response cache.
+        static
+        std::string
+        key(const api::event_t& event,
+            const std::vector<std::string>& chunks);
+
+        // Subscribes the upstream to an identical session in flight, or starts
+        // a new flight, in which case the caller becomes its leader and has to
+        // enqueue the session using the flight as the session upstream.
+        boost::shared_ptr<flight_t>
+        join(const std::string& key,
+             const boost::shared_ptr<api::stream_t>& upstream,
+             bool& leader);
+
+        void
+        forget(const std::string& key,
+               const flight_t * flight);
+
+        Json::Value
+        info();
+
+    private:
+        const boost::shared_ptr<handle_t> m_handle;
+
+        std::set<std::string> m_events;
+
+#if BOOST_VERSION >= 103600
+        typedef boost::unordered_map<
+#else
+        typedef std::map<
+#endif
+            std::string,
+            boost::shared_ptr<flight_t>
+        > flight_map_t;
+
+        flight_map_t m_flights;
+        boost::mutex m_mutex;
+
+        // Statistics.
+        std::atomic<uint64_t> m_started;
+        std::atomic<uint64_t> m_joined;
+};
+
+}} // namespace cocaine::engine
+
+#endif
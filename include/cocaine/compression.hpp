@@ -0,0 +1,77 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_COMPRESSION_HPP
+#define COCAINE_COMPRESSION_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/json.hpp"
+
+#include <atomic>
+
+namespace cocaine {
+
+// NOTE: LZ4 block compression for the large message bodies, available only if
+// the core has been built with it. Compression ratio and CPU time are accounted
+// in the statistics object, if there's one.
+
+class compressor_t:
+    public boost::noncopyable
+{
+    public:
+        compressor_t();
+
+        static
+        bool
+        available();
+
+        // Compresses the data, unless it doesn't shrink or the compression is
+        // not available, in which case returns false.
+        bool
+        compress(const char * data,
+                 size_t size,
+                 std::string& result);
+
+        // Throws if the data is corrupted or the compression is not available.
+        void
+        decompress(const char * data,
+                   size_t size,
+                   size_t original,
+                   std::string& result);
+
+        Json::Value
+        info() const;
+
+    private:
+        std::atomic<uint64_t> m_compressed,
+                              m_skipped,
+                              m_decompressed;
+
+        // NOTE: The totals of the bytes before and after the compression, and the
+        // time spent in both directions, in microseconds.
+        std::atomic<uint64_t> m_raw_bytes,
+                              m_packed_bytes,
+                              m_compression_time,
+                              m_decompression_time;
+};
+
+} // namespace cocaine
+
+#endif
@@ -0,0 +1,2 @@
+#define COCAINE_VERSION 0.10
+/* #undef COCAINE_HAVE_LZ4 */
@@ -22,6 +22,7 @@
 #define COCAINE_CONTEXT_HPP
 
 #include "cocaine/common.hpp"
+#include "cocaine/atomic.hpp"
 #include "cocaine/json.hpp"
 #include "cocaine/repository.hpp"
 
@@ -40,12 +41,40 @@ struct defaults {
     static const float idle_timeout;
     static const float startup_timeout;
     static const float termination_timeout;
+    static const float drain_timeout;
     static const unsigned long pool_limit;
     static const unsigned long queue_limit;
+    static const unsigned long pending_limit;
+    static const unsigned long queue_bytes;
+    static const unsigned long queue_memory;
+    static const unsigned long shm_ring;
+    static const unsigned long fd_threshold;
+    static const unsigned long compression_threshold;
     static const unsigned long concurrency;
+    static const unsigned long batch_size;
+    static const unsigned long session_window;
+    static const unsigned long max_sessions;
+    static const unsigned long max_rss;
+    static const float spawn_rate;
+    static const float spawn_backoff;
+    static const float weight;
+
+    // Default node limits.
+    static const unsigned long concurrent_spawns;
+
+    // NOTE: The number of the handler names the slaves of a single app can add
+    // to the process-wide symbol table.
+    static const unsigned long symbol_quota;
+
+    // Default host pressure thresholds.
+    static const float pressure_interval;
+    static const float memory_pressure;
+    static const float cpu_pressure;
+    static const float available_memory;
 
     // Default I/O policy.
     static const long control_timeout;
+    static const float status_interval;
     static const unsigned long io_bulk_size;
 
     // Default paths.
@@ -72,6 +101,27 @@ struct config_t {
         unsigned int threads;
     } network;
 
+    struct {
+        // The number of slaves activating at the same time, node-wide.
+        unsigned long spawns;
+
+        // The total number of slaves and their total resident set size in
+        // bytes, shared between the apps. Zero means no limit.
+        unsigned long slaves;
+        unsigned long memory;
+    } limits;
+
+    struct {
+        // Sampling interval in seconds, zero disables the monitoring.
+        float interval;
+
+        // NOTE: Stall percentages and the available memory fraction at which
+        // the host is considered to be under pressure, see pressure_monitor_t.
+        float memory;
+        float cpu;
+        float available;
+    } pressure;
+
     struct component_t {
         std::string type;
         Json::Value args;
@@ -117,6 +167,34 @@ private:
     boost::mutex m_mutex;
 };
 
+// Spawn budget
+
+struct spawn_budget_t {
+    spawn_budget_t(unsigned long limit);
+
+    // NOTE: Reserves a slot for a slave which is about to be spawned, the slot
+    // is released when the slave activates or dies. Zero limit means no limit.
+    bool
+    acquire();
+
+    void
+    release();
+
+    unsigned long
+    limit() const {
+        return m_limit;
+    }
+
+    unsigned long
+    used() const {
+        return m_used;
+    }
+
+private:
+    const unsigned long m_limit;
+    std::atomic<unsigned long> m_used;
+};
+
 // Context
 
 class context_t:
@@ -145,6 +223,27 @@ class context_t:
             return *m_port_mapper;
         }
 
+        // Spawn budget
+
+        spawn_budget_t&
+        spawns() {
+            return *m_spawn_budget;
+        }
+
+        // Node-wide slave sharing
+
+        engine::pool_arbiter_t&
+        pools() {
+            return *m_pool_arbiter;
+        }
+
+        // Host pressure
+
+        pressure_monitor_t&
+        pressure() {
+            return *m_pressure_monitor;
+        }
+
         // Component API
         
         template<class Category, typename... Args>
@@ -169,6 +268,9 @@ class context_t:
     private:
         std::unique_ptr<zmq::context_t> m_io;
         std::unique_ptr<port_mapper_t> m_port_mapper;
+        std::unique_ptr<spawn_budget_t> m_spawn_budget;
+        std::unique_ptr<engine::pool_arbiter_t> m_pool_arbiter;
+        std::unique_ptr<pressure_monitor_t> m_pressure_monitor;
 
         // NOTE: This is the first object in the component tree, all the other
         // components, including loggers, storages or isolates have to be declared
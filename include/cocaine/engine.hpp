@@ -25,13 +25,17 @@
 #include "cocaine/asio.hpp"
 #include "cocaine/atomic.hpp"
 #include "cocaine/channel.hpp"
+#include "cocaine/compression.hpp"
+#include "cocaine/histogram.hpp"
+#include "cocaine/json.hpp"
 
 #include "cocaine/api/isolate.hpp"
 
 #include <deque>
 
-#include <boost/thread/condition.hpp>
+#include <boost/function.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 namespace cocaine { namespace engine {
 
@@ -58,20 +62,48 @@ class session_queue_t:
         boost::mutex m_mutex;
 };
 
+// NOTE: A weak reference to the engine for the streams handed out to the clients,
+// which might outlive the engine. The engine resets it on destruction, and the
+// streams only use the engine while holding the shared lock.
+
+struct handle_t:
+    public boost::noncopyable
+{
+    handle_t(engine_t * engine_):
+        engine(engine_)
+    { }
+
+    boost::shared_mutex mutex;
+    engine_t * engine;
+};
+
 class engine_t:
     public boost::noncopyable
 {
     enum class state_t: int {
         running,
+        draining,
         broken,
         stopping,
         stopped
     };
 
+    public:
+        // NOTE: Invoked with the session downstream when the session is admitted
+        // into the queue, or with an empty pointer if the session was dropped.
+        typedef boost::function<
+            void(const boost::shared_ptr<api::stream_t>&)
+        > callback_type;
+
+        typedef std::vector<
+            std::pair<api::event_t, boost::shared_ptr<api::stream_t>>
+        > batch_type;
+
     public:
         engine_t(context_t& context,
-                 const manifest_t& manifest,
-                 const profile_t& profile);
+                 const boost::shared_ptr<const manifest_t>& manifest,
+                 const boost::shared_ptr<const profile_t>& profile,
+                 const std::string& path);
 
         ~engine_t();
 
@@ -85,6 +117,65 @@ class engine_t:
                 const boost::shared_ptr<api::stream_t>& upstream,
                 engine::mode mode = engine::mode::normal);
 
+        void
+        enqueue_async(const api::event_t& event,
+                      const boost::shared_ptr<api::stream_t>& upstream,
+                      const callback_type& callback);
+
+        std::vector<boost::shared_ptr<api::stream_t>>
+        enqueue_batch(const batch_type& batch);
+
+        // NOTE: Enqueues a session with a complete request, unless it's served
+        // from the response cache or coalesced with an identical session in
+        // flight. Returns the client's subscription, if any.
+        boost::shared_ptr<api::stream_t>
+        replay(const api::event_t& event,
+               const boost::shared_ptr<api::stream_t>& upstream,
+               const std::vector<std::string>& chunks);
+
+        // NOTE: Drops the session from the queue or tells the responsible slave
+        // to abandon it. Thread-safe, the work is done in the engine thread.
+        void
+        cancel(const boost::shared_ptr<session_t>& session);
+
+        // NOTE: Holds the flow control credits for the session back until its
+        // upstream becomes writable, so that a slow client throttles the slave.
+        // Only called from the engine thread.
+        void
+        withhold(const boost::shared_ptr<session_t>& session,
+                 uint64_t credits);
+
+        // NOTE: Grants the withheld credits once the session upstream has become
+        // writable. Thread-safe, the work is done in the engine thread.
+        void
+        resume(const boost::shared_ptr<session_t>& session);
+
+        // NOTE: Switches the engine to a new app version. The new slaves are
+        // warmed up alongside the current ones, which keep serving the queue
+        // until the switch. If only the profile has changed and the isolate
+        // settings are the same, it's applied in place to the current slaves.
+        // The path is the directory the new version has been deployed to, which
+        // is removed if the upgrade is rolled back, or empty to keep the current
+        // one. Thread-safe, the work is done in the engine thread.
+        void
+        upgrade(const boost::shared_ptr<const manifest_t>& manifest,
+                const boost::shared_ptr<const profile_t>& profile,
+                const std::string& path);
+
+        // NOTE: The current app version, which is only switched once an upgrade
+        // has completed. Thread-safe.
+        boost::shared_ptr<const manifest_t>
+        manifest() const;
+
+        boost::shared_ptr<const profile_t>
+        profile() const;
+
+        // NOTE: Returns the latest engine status snapshot, published by the engine
+        // thread at most every status interval. Thread-safe, never blocks on the
+        // engine thread.
+        Json::Value
+        info() const;
+
         template<class Event, typename... Args>
         bool
         send(const unique_id_t& uuid,
@@ -101,7 +192,50 @@ class engine_t:
             return m_loop;
         }
 
+        // Chunk compression for the slaves which support it.
+        compressor_t&
+        compressor() {
+            return m_compressor;
+        }
+
+        // Session latency statistics, recorded by the engine and its slaves.
+        latency_t&
+        latency() {
+            return m_latency;
+        }
+
+        // NOTE: Interns a handler name announced by a slave, as long as the app
+        // hasn't used up its share of the process-wide symbol table, so that a
+        // single app couldn't fill it for everyone else. Only called from the
+        // engine thread.
+        symbol_t
+        intern(const std::string& name);
+
     private:
+        typedef std::deque<
+            std::pair<boost::shared_ptr<session_t>, callback_type>
+        > pending_queue_t;
+
+        struct upgrade_t {
+            boost::shared_ptr<const manifest_t> manifest;
+            boost::shared_ptr<const profile_t> profile;
+
+            // The directory the new version has been deployed to, if any.
+            std::string path;
+
+            // NOTE: Keeps the new isolate alive while the slaves are warmed up,
+            // see the m_isolate comment below.
+            api::category_traits<api::isolate_t>::ptr_type isolate;
+
+            // The generation being warmed up.
+            unsigned int generation;
+
+            // The number of active slaves required for the switch.
+            size_t target;
+
+            ev::tstamp started;
+        };
+
         void
         on_bus_event(ev::io&, int);
         
@@ -122,6 +256,18 @@ class engine_t:
 
         void
         on_termination(ev::timer&, int);
+
+        void
+        on_hedge(ev::timer&, int);
+
+        void
+        on_drain_timeout(ev::timer&, int);
+
+        void
+        on_snapshot(ev::check&, int);
+
+        void
+        on_snapshot_timeout(ev::timer&, int);
         
         void
         process_bus_events();
@@ -129,12 +275,100 @@ class engine_t:
         void
         process_ctl_events();
 
+        void
+        process_cancellations();
+
+        void
+        process_resumptions();
+
+        Json::Value
+        status();
+
+        void
+        publish();
+
+        void
+        process_upgrades();
+
+        // NOTE: Applies the new profile in place, keeping the current slaves.
+        void
+        reconfigure(const boost::shared_ptr<const profile_t>& profile);
+
+        // NOTE: Switches to the warmed up generation once it's ready, or rolls
+        // the upgrade back if none of its slaves activate in time.
+        void
+        complete_upgrade();
+
+        // NOTE: Makes the given app version directory the current one.
+        void
+        activate(const std::string& path);
+
+        // NOTE: Both the sessions and their downstreams are allocated from the
+        // engine slab, see the slab_t class for the details.
+        boost::shared_ptr<session_t>
+        create(const api::event_t& event,
+               const boost::shared_ptr<api::stream_t>& upstream);
+
+        boost::shared_ptr<api::stream_t>
+        downstream(const boost::shared_ptr<session_t>& session);
+
+        void
+        submit(const boost::shared_ptr<session_t>& session);
+
         void
         pump();
+
+        boost::shared_ptr<session_t>
+        dequeue(bool complete);
+
+        // NOTE: The queue limit with regard to the host pressure.
+        unsigned long
+        queue_limit() const;
+
+        // NOTE: Checks whether the queue has no space for the incoming sessions,
+        // either by their number or by the bytes the clients have sent.
+        bool
+        saturated(size_t incoming = 1) const;
+
+        void
+        promote(pending_queue_t& admitted);
         
         void
         balance();
 
+        // NOTE: Grows the pool of the current generation, unless the host is
+        // under pressure.
+        bool
+        spawn();
+
+        // NOTE: Spawns a slave regardless of the host pressure, either for the
+        // upgrade warm-up or as a replacement for a retiring one.
+        bool
+        spawn(unsigned int generation,
+              const boost::shared_ptr<const manifest_t>& manifest,
+              const boost::shared_ptr<const profile_t>& profile,
+              const std::string& path);
+
+        void
+        backoff();
+
+        // NOTE: The number of slaves needed to keep up with the current load.
+        size_t
+        demand() const;
+
+        // NOTE: Reports the pool demand and usage to the node and returns the
+        // app's share of the node-wide slave limit.
+        size_t
+        report();
+
+        void
+        retire(const unique_id_t& slave_id,
+               const std::string& reason,
+               bool replace = true);
+
+        void
+        drain();
+
         void
         migrate(state_t target);
         
@@ -145,8 +379,19 @@ class engine_t:
         context_t& m_context;
         std::unique_ptr<logging::log_t> m_log;
 
-        const manifest_t& m_manifest;
-        const profile_t& m_profile;
+        // NOTE: The current app version. Replaced by the engine thread under
+        // the session queue lock when the engine is upgraded.
+        boost::shared_ptr<const manifest_t> m_manifest;
+        boost::shared_ptr<const profile_t> m_profile;
+
+        unsigned int m_generation,
+                     m_next_generation;
+
+        // NOTE: The directories the current and the previous app versions are
+        // deployed to. The previous one is kept for the superseded slaves until
+        // the next upgrade completes or the engine stops.
+        std::string m_path,
+                    m_previous;
 
         // Engine state
 
@@ -168,16 +413,95 @@ class engine_t:
                     m_ctl_checker;
 
         ev::timer m_gc_timer,
-                  m_termination_timer;
+                  m_termination_timer,
+                  m_hedge_timer,
+                  m_drain_timer;
 
         ev::async m_notification;
 
+        // NOTE: The status snapshot is rebuilt after the loop iterations which
+        // have changed the engine state, but not more often than the status
+        // interval, with a timer to catch up on the changes made since the last
+        // snapshot once the loop goes idle. The state is marked as changed by
+        // the bus, control, notification and cleanup handlers.
+        ev::check m_snapshot_checker;
+        ev::timer m_snapshot_timer;
+
+        boost::shared_ptr<const Json::Value> m_snapshot;
+        ev::tstamp m_published;
+        bool m_dirty;
+
+        // Weak reference to the engine for the client streams.
+        const boost::shared_ptr<handle_t> m_handle;
+
         // Auto-incrementing Session ID.
         std::atomic<uint64_t> m_next_id;
 
+        // Per-request object allocator.
+        boost::shared_ptr<slab_t> m_slab;
+
+        // Pre-attach request bytes accounting and spilling.
+        boost::shared_ptr<spool_t> m_spool;
+
+        compressor_t m_compressor;
+
+        latency_t m_latency;
+
+        // The number of the symbols interned on behalf of this app.
+        size_t m_interned;
+
         // Session queue
         session_queue_t m_queue;
-        boost::condition_variable_any m_condition;
+
+        // NOTE: Sessions waiting for the queue space to become available, admitted
+        // in the FIFO order as the queue drains. Guarded by the session queue lock.
+        pending_queue_t m_pending;
+
+        // Sessions abandoned by their clients, guarded by the session queue lock.
+        std::vector<boost::shared_ptr<session_t>> m_cancelled;
+
+        // Sessions with the withheld credits whose upstreams have drained, guarded
+        // by the session queue lock.
+        std::vector<boost::shared_ptr<session_t>> m_resumed;
+
+        // NOTE: The drain progress, i.e. when it has been started and how many
+        // sessions there were in the queue at that moment.
+        ev::tstamp m_drain_started;
+        size_t m_drain_total;
+
+        // NOTE: The requested upgrade is guarded by the session queue lock, the
+        // one in progress is only accessed from the engine thread.
+        std::unique_ptr<upgrade_t> m_requested_upgrade;
+        std::unique_ptr<upgrade_t> m_upgrade;
+
+        // NOTE: Spawn control. The number of consecutive activation failures and
+        // the time until which no slaves are spawned because of them.
+        std::unique_ptr<token_bucket_t> m_spawn_limiter;
+
+        unsigned int m_spawn_failures;
+        ev::tstamp m_spawn_backoff;
+
+        struct {
+            uint64_t spawned;
+            uint64_t failed;
+            uint64_t throttled;
+            uint64_t deferred;
+        } m_spawn_stats;
+
+        // The pool resident set size, as of the last cleanup.
+        size_t m_resident;
+
+        // Rate limiting
+        std::unique_ptr<admission_t> m_admission;
+
+        // Request hedging
+        std::unique_ptr<hedging_t> m_hedging;
+
+        // Request coalescing
+        boost::shared_ptr<coalescer_t> m_coalescer;
+
+        // Response caching
+        std::unique_ptr<response_cache_t> m_cache;
 
         // Slave pool
 
@@ -52,6 +52,22 @@ namespace io {
         struct info {
             typedef tags::node_tag tag;
         };
+
+        struct upgrade_app {
+            typedef tags::node_tag tag;
+
+            typedef boost::mpl::list<
+                /* runlist */ std::map<std::string, std::string>
+            > tuple_type;
+        };
+
+        struct reload_app {
+            typedef tags::node_tag tag;
+
+            typedef boost::mpl::list<
+                /* runlist */ std::map<std::string, std::string>
+            > tuple_type;
+        };
     }
 
     template<>
@@ -59,7 +75,9 @@ namespace io {
         typedef mpl::list<
             node::start_app,
             node::pause_app,
-            node::info
+            node::info,
+            node::upgrade_app,
+            node::reload_app
         > type;
     };
 } // namespace io
@@ -81,6 +99,9 @@ class node_t:
         void
         on_announce(ev::timer&, int);
 
+        void
+        on_reap(ev::timer&, int);
+
         Json::Value
         on_start_app(const std::map<std::string, std::string>& runlist);
 
@@ -90,6 +111,12 @@ class node_t:
         Json::Value
         on_info() const;
 
+        Json::Value
+        on_upgrade_app(const std::map<std::string, std::string>& runlist);
+
+        Json::Value
+        on_reload_app(const std::map<std::string, std::string>& runlist);
+
     private:
         context_t& m_context;
         std::unique_ptr<logging::log_t> m_log;
@@ -112,6 +139,11 @@ class node_t:
         // Apps.
         app_map_t m_apps;
 
+        // NOTE: Paused apps are drained in the background, and are reaped
+        // by the timer once their engines have stopped.
+        app_map_t m_draining;
+        ev::timer m_reap_timer;
+
         // Uptime.
         const ev::tstamp m_birthstamp;
 };
@@ -24,6 +24,9 @@
 namespace cocaine {
     // Runtime context.
     class context_t;
+
+    // Host pressure monitoring.
+    class pressure_monitor_t;
     
     // App configuration.
     struct manifest_t;
@@ -57,6 +60,32 @@ namespace cocaine {
         // Execution engine.
         class engine_t;
         class slave_t;
+
+        // Weak reference to an engine.
+        struct handle_t;
+
+        // Admission control.
+        class admission_t;
+        class token_bucket_t;
+
+        // Request hedging.
+        class hedging_t;
+
+        // Request coalescing.
+        class coalescer_t;
+
+        // Response caching.
+        class response_cache_t;
+
+        // Node-wide slave sharing.
+        class pool_arbiter_t;
+
+        // Per-request object allocation.
+        class slab_t;
+
+        // Pre-attach request buffering.
+        class spool_t;
+        class spill_t;
     }
 
     namespace io {
@@ -0,0 +1,230 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_HEDGING_HPP
+#define COCAINE_HEDGING_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/json.hpp"
+#include "cocaine/unique_id.hpp"
+
+#include "cocaine/api/event.hpp"
+#include "cocaine/api/stream.hpp"
+
+#include <list>
+#include <set>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: Multiplexes the results of several duplicate sessions into the client's
+// upstream. The first session to respond wins, the others get cancelled and
+// whatever they manage to send afterwards is discarded. Only accessed from the
+// engine thread.
+
+class arbiter_t:
+    public boost::noncopyable,
+    public boost::enable_shared_from_this<arbiter_t>
+{
+    public:
+        arbiter_t(engine_t& engine,
+                  const boost::shared_ptr<api::stream_t>& upstream);
+
+        // Creates a new contender stream. The session which uses it should then
+        // be bound to the arbiter in the same order as the streams were created.
+        boost::shared_ptr<api::stream_t>
+        lane();
+
+        void
+        bind(const boost::shared_ptr<session_t>& session);
+
+        void
+        push(size_t lane,
+             const char * chunk,
+             size_t size);
+
+        void
+        error(size_t lane,
+              error_code code,
+              const std::string& message);
+
+        void
+        close(size_t lane);
+
+    public:
+        bool
+        decided() const {
+            return m_winner != none;
+        }
+
+        size_t
+        winner() const {
+            return m_winner;
+        }
+
+        // The time of the first response, in the engine loop time.
+        double
+        decided_at() const {
+            return m_decided_at;
+        }
+
+        // NOTE: The flow control is passed through to the client's upstream.
+        const boost::shared_ptr<api::stream_t>&
+        upstream() const {
+            return m_upstream;
+        }
+
+    private:
+        bool
+        select(size_t lane);
+
+    private:
+        static const size_t none = static_cast<size_t>(-1);
+
+        engine_t& m_engine;
+
+        const boost::shared_ptr<api::stream_t> m_upstream;
+
+        size_t m_lanes;
+        std::vector<boost::weak_ptr<session_t>> m_sessions;
+
+        size_t m_winner;
+        double m_decided_at;
+};
+
+class hedging_t:
+    public boost::noncopyable
+{
+    public:
+        typedef std::vector<
+            std::pair<int, std::string>
+        > frame_list_t;
+
+        struct entry_t {
+            entry_t(const boost::shared_ptr<session_t>& session,
+                    const boost::shared_ptr<arbiter_t>& arbiter,
+                    const unique_id_t& slave,
+                    const frame_list_t& frames,
+                    double dispatched_at);
+
+            const boost::weak_ptr<session_t> session;
+            const boost::shared_ptr<arbiter_t> arbiter;
+            const api::event_t event;
+
+            // The slave processing the original session.
+            const unique_id_t slave;
+
+            // The complete request, as it was sent to the slave.
+            const frame_list_t frames;
+
+            const double dispatched_at;
+            bool hedged;
+        };
+
+    public:
+        hedging_t(const Json::Value& args);
+
+        // NOTE: Thread-safe, as the configuration is never modified.
+        bool
+        eligible(const api::event_t& event) const;
+
+        // Starts tracking a complete session which has just been dispatched.
+        void
+        track(const boost::shared_ptr<session_t>& session,
+              const unique_id_t& slave,
+              double now);
+
+        // Retires the sessions which have already responded or vanished, and
+        // collects the ones which have been waiting for too long.
+        void
+        scan(double now,
+             std::vector<entry_t*>& due);
+
+        // Consumes a token from the hedging budget.
+        bool
+        acquire();
+
+        // Rebinds the request frames to a different session.
+        static
+        frame_list_t
+        replay(const entry_t& entry,
+               uint64_t tag);
+
+        Json::Value
+        info() const;
+
+    public:
+        bool
+        enabled() const {
+            return !m_events.empty();
+        }
+
+        double
+        interval() const {
+            return m_interval;
+        }
+
+    private:
+        double
+        delay(const std::string& event) const;
+
+        void
+        sample(const std::string& event,
+               double latency);
+
+    private:
+        std::set<std::string> m_events;
+
+        // Configuration.
+        double m_percentile;
+        double m_budget;
+        double m_burst;
+        double m_min_delay;
+        double m_interval;
+
+        // NOTE: Every dispatched session adds a fraction of a token to the budget,
+        // so that the hedges never exceed the configured share of the traffic.
+        double m_tokens;
+
+        std::list<entry_t> m_tracked;
+
+        struct samples_t {
+            samples_t():
+                next(0)
+            { }
+
+            std::vector<double> ring;
+            size_t next;
+        };
+
+        // First response latencies for every eligible event type.
+        std::map<std::string, samples_t> m_samples;
+
+        // Statistics.
+        uint64_t m_dispatched;
+        uint64_t m_hedged;
+        uint64_t m_won;
+};
+
+}} // namespace cocaine::engine
+
+#endif
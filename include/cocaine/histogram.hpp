@@ -0,0 +1,153 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_HISTOGRAM_HPP
+#define COCAINE_HISTOGRAM_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/json.hpp"
+#include "cocaine/symbol.hpp"
+
+#include <array>
+
+namespace cocaine { namespace engine {
+
+// NOTE: Log-linear histogram of durations, in the spirit of HDR histograms. The
+// values are counted in microseconds, each power of two is split into a fixed
+// number of linear sub-buckets, so that the relative error of the percentiles
+// stays within 1 / 2^precision, with a fixed memory footprint and O(1) inserts.
+
+class histogram_t:
+    public boost::noncopyable
+{
+    public:
+        histogram_t();
+
+        void
+        record(int64_t nanoseconds);
+
+        // The value below which the given fraction of the recorded values falls,
+        // in seconds.
+        double
+        percentile(double fraction) const;
+
+        uint64_t
+        count() const {
+            return m_count;
+        }
+
+        Json::Value
+        info() const;
+
+    private:
+        static const unsigned int precision = 3;
+        static const unsigned int magnitude = 40;
+
+        static const size_t buckets = (magnitude - precision + 1) << precision;
+
+        static
+        size_t
+        index(uint64_t value);
+
+        static
+        uint64_t
+        midpoint(size_t index);
+
+    private:
+        std::array<uint64_t, buckets> m_buckets;
+
+        uint64_t m_count;
+        uint64_t m_max;
+};
+
+// NOTE: Streaming latencies of the engine sessions, per app and per event type,
+// measured from the session creation to its dispatch to a slave, and from the
+// dispatch to the first reply chunk and to the completion. Only accessed from
+// the engine thread, so the recording is lock-free.
+
+class latency_t:
+    public boost::noncopyable
+{
+    public:
+        enum stages: int {
+            queue,
+            response,
+            completion
+        };
+
+    public:
+        latency_t();
+
+        // Monotonic clock, in nanoseconds.
+        static
+        int64_t
+        now();
+
+        void
+        record(const symbol_t& event,
+               stages stage,
+               int64_t nanoseconds);
+
+        // NOTE: Not const, because the throughput is measured between the calls,
+        // over the windows of at least a second.
+        Json::Value
+        info();
+
+    private:
+        struct timings_t {
+            timings_t();
+
+            void
+            record(stages stage,
+                   int64_t nanoseconds);
+
+            Json::Value
+            info(int64_t now);
+
+            std::string name;
+
+            std::array<histogram_t, 3> histograms;
+
+            // Throughput window, in completions per second.
+            int64_t window_start;
+            uint64_t window_count;
+            double throughput;
+        };
+
+        // NOTE: Only the interned event types are tracked individually, and only up
+        // to a limit, so that the memory usage is bounded no matter how many event
+        // types the clients come up with. The rest only count towards the totals.
+        static const size_t max_events = 64;
+
+        timings_t m_total;
+
+        // Indexed by the event type symbol ID.
+        std::vector<std::unique_ptr<timings_t>> m_events;
+
+        // Event types tracked so far.
+        size_t m_tracked;
+
+        // Samples of the event types beyond the limit.
+        uint64_t m_untracked;
+};
+
+}} // namespace cocaine::engine
+
+#endif
@@ -0,0 +1,135 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_MEMFD_HPP
+#define COCAINE_MEMFD_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/asio.hpp"
+
+#include <boost/thread/mutex.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: A read-only mapping of a sealed memory file, holding a large message
+// body passed between the processes by its descriptor instead of the bytes.
+
+class memfd_t:
+    public boost::noncopyable
+{
+    public:
+        // Adopts a received descriptor and maps the specified number of bytes.
+        memfd_t(int fd,
+                size_t size);
+
+        ~memfd_t();
+
+        // Creates a sealed memory file with a copy of the data and returns its
+        // descriptor, which is owned by the caller.
+        static
+        int
+        create(const char * data,
+               size_t size);
+
+        const char*
+        data() const {
+            return m_data;
+        }
+
+        size_t
+        size() const {
+            return m_size;
+        }
+
+    private:
+        const int m_fd;
+        const size_t m_size;
+
+        char * m_data;
+};
+
+// NOTE: A Unix socket next to the bus for passing the memory file descriptors to
+// and from a single slave. The engine listens on a socket named after the slave,
+// and the slave is expected to connect to it after the handshake. Descriptors are
+// sent before their announcements on the bus, and both sides take them from the
+// socket in the announcement order, so the producers must hold the channel lock
+// while sending both the descriptor and the announcement.
+
+class fd_channel_t:
+    public boost::noncopyable
+{
+    public:
+        fd_channel_t(const std::string& path,
+                     size_t threshold,
+                     ev::loop_ref& loop);
+
+        ~fd_channel_t();
+
+        // NOTE: The following methods must be called with the channel locked.
+
+        bool
+        connected() const {
+            return m_socket != -1;
+        }
+
+        // Passes the descriptor to the slave, returns false on failure, or if
+        // the socket buffer is full. Never blocks.
+        bool
+        send(int fd);
+
+        // Takes the next descriptor passed by the slave, throws if there's none.
+        int
+        recv();
+
+        // The smallest message body worth passing by descriptor.
+        size_t
+        threshold() const {
+            return m_threshold;
+        }
+
+        void
+        lock() {
+            m_mutex.lock();
+        }
+
+        void
+        unlock() {
+            m_mutex.unlock();
+        }
+
+    private:
+        void
+        on_connection(ev::io&, int);
+
+    private:
+        const std::string m_path;
+        const size_t m_threshold;
+
+        int m_listener,
+            m_socket;
+
+        ev::io m_watcher;
+
+        boost::mutex m_mutex;
+};
+
+}} // namespace cocaine::engine
+
+#endif
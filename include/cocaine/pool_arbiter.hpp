@@ -0,0 +1,111 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_POOL_ARBITER_HPP
+#define COCAINE_POOL_ARBITER_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/json.hpp"
+
+#include <boost/thread/mutex.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: Shares the node-wide slave limit between the apps using the weighted
+// max-min fairness. Each engine periodically reports its demand, i.e. how many
+// slaves it needs to keep up with its queue, and gets its share of the limit in
+// return. Shares in excess of the demand are only granted while there's spare
+// capacity, so that the idle slaves of the quiet apps are reclaimed as soon as
+// the busier apps need them.
+
+class pool_arbiter_t:
+    public boost::noncopyable
+{
+    public:
+        pool_arbiter_t(unsigned long slaves,
+                       unsigned long memory);
+
+        // NOTE: Updates the app's demand and usage, returning its current share
+        // of the node slave limit.
+        size_t
+        update(const std::string& name,
+               double weight,
+               size_t demand,
+               size_t size,
+               size_t resident);
+
+        void
+        remove(const std::string& name);
+
+        Json::Value
+        info() const;
+
+    public:
+        bool
+        enabled() const {
+            return m_slaves || m_memory;
+        }
+
+    private:
+        void
+        rebalance();
+
+    private:
+        // Node limits, zero means no limit.
+        const unsigned long m_slaves;
+        const unsigned long m_memory;
+
+        struct entry_t {
+            double weight;
+
+            size_t demand,
+                   size,
+                   resident,
+                   share;
+
+            // Fractional share, used while the shares are being computed.
+            double fair;
+
+            // The last rebalance the app has been granted a slave at.
+            uint64_t granted;
+        };
+
+#if BOOST_VERSION >= 103600
+        typedef boost::unordered_map<
+#else
+        typedef std::map<
+#endif
+            std::string,
+            entry_t
+        > entry_map_t;
+
+        entry_map_t m_entries;
+
+        // NOTE: Rebalance counter. When there's not enough slaves for everyone,
+        // the ties go to the apps which have been granted a slave least recently,
+        // so that it's not the same app which is starved on every rebalance.
+        uint64_t m_epoch;
+
+        mutable boost::mutex m_mutex;
+};
+
+}} // namespace cocaine::engine
+
+#endif
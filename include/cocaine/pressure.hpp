@@ -0,0 +1,91 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_PRESSURE_HPP
+#define COCAINE_PRESSURE_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/atomic.hpp"
+#include "cocaine/context.hpp"
+#include "cocaine/json.hpp"
+
+#include <boost/thread/mutex.hpp>
+
+namespace cocaine {
+
+// NOTE: Samples the host pressure stall information and the available memory,
+// so that the engines could stop growing their pools when the host is already
+// overloaded. The sampling is driven by the runtime timer, the level itself can
+// be read from any thread.
+
+class pressure_monitor_t:
+    public boost::noncopyable
+{
+    public:
+        enum class level_t: int {
+            // Everything is fine.
+            normal,
+
+            // Some threshold has been exceeded, the pools shouldn't grow.
+            elevated,
+
+            // Some threshold has been exceeded by far, the pools don't grow at
+            // all and the queues are shortened to shed the load early.
+            critical
+        };
+
+    public:
+        pressure_monitor_t(const config_t& config);
+
+        void
+        sample();
+
+        level_t
+        level() const {
+            return static_cast<level_t>(m_level.load());
+        }
+
+        Json::Value
+        info() const;
+
+    private:
+        // Memory and CPU stall percentages, as in the "some avg10" PSI fields.
+        const float m_memory_threshold;
+        const float m_cpu_threshold;
+
+        // Available memory fraction.
+        const float m_available_threshold;
+
+        std::atomic<int> m_level;
+
+        // Last sample, guarded by the mutex.
+        double m_memory;
+        double m_cpu;
+        double m_available;
+
+        // NOTE: Older kernels don't have the pressure stall information.
+        bool m_psi;
+
+        mutable boost::mutex m_mutex;
+};
+
+} // namespace cocaine
+
+#endif
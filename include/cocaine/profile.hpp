@@ -40,14 +40,77 @@ struct profile_t:
     float idle_timeout;
     float startup_timeout;
     float termination_timeout;
+    float drain_timeout;
     unsigned long pool_limit;
     unsigned long queue_limit;
     unsigned long grow_threshold;
     unsigned long concurrency;
 
+    // NOTE: The limit on the sessions waiting for the queue space to become
+    // available, or zero for no limit.
+    unsigned long pending_limit;
+
+    // NOTE: The limit on the bytes sent by the clients for the queued sessions,
+    // or zero for no limit. Up to the memory budget they're kept in memory, and
+    // the rest is spilled to disk.
+    unsigned long queue_bytes;
+    unsigned long queue_memory;
+
+    // NOTE: The maximum number of complete sessions packed into a single
+    // invocation message for the slaves which support batching.
+    unsigned long batch_size;
+
+    // NOTE: The maximum number of chunks in flight for every session in each
+    // direction, or zero to disable the flow control.
+    unsigned long session_window;
+
+    // NOTE: The size of the shared memory rings for the chunks exchanged with
+    // the slaves which support them, or zero to use the bus only.
+    unsigned long shm_ring;
+
+    // NOTE: The chunks of at least this size are passed to and from the slaves
+    // which support it as memory file descriptors, or never if it's zero.
+    unsigned long fd_threshold;
+
+    // NOTE: The chunks of at least this size are compressed for the slaves which
+    // support it, if the core is built with the compression support, or never if
+    // it's zero.
+    unsigned long compression_threshold;
+
+    // NOTE: Slaves are gracefully recycled after processing this many sessions
+    // or growing beyond this resident set size in bytes. Zero means no limit.
+    unsigned long max_sessions;
+    unsigned long max_rss;
+
+    // NOTE: The pool is grown by at most this many slaves per second, or with
+    // no limit if it's zero. Consecutive activation failures back the spawning
+    // off exponentially, up to the maximum backoff in seconds.
+    float spawn_rate;
+    float spawn_backoff;
+
+    // NOTE: The app's weight when the node-wide slave limit is shared between
+    // the apps, see the pool_arbiter_t class for the details.
+    float weight;
+
     // NOTE: The slave processes are launched in sandboxed environments,
     // called isolates. This one describes the isolate type and arguments.
     config_t::component_t isolate;
+
+    // NOTE: Per-driver and per-client rate limits for the incoming events,
+    // see the admission_t class for the details.
+    Json::Value admission;
+
+    // NOTE: Hedging policy for the tail-latency-sensitive events, see the
+    // hedging_t class for the details.
+    Json::Value hedging;
+
+    // NOTE: Events for which the identical concurrent requests are served by
+    // a single session, see the coalescer_t class for the details.
+    Json::Value coalescing;
+
+    // NOTE: Events with cacheable responses and the cache configuration, see
+    // the response_cache_t class for the details.
+    Json::Value caching;
 };
 
 } // namespace cocaine
@@ -0,0 +1,123 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_RESPONSE_CACHE_HPP
+#define COCAINE_RESPONSE_CACHE_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/atomic.hpp"
+#include "cocaine/json.hpp"
+
+#include "cocaine/api/event.hpp"
+
+#include <list>
+#include <set>
+
+#include <boost/thread/mutex.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: Caches the complete responses of the idempotent events, keyed by the
+// event type and the request body. The entries expire after a fixed TTL, and the
+// least recently used ones are evicted when the memory budget is exceeded.
+
+class response_cache_t:
+    public boost::noncopyable
+{
+    public:
+        typedef std::vector<std::string> chunk_list_t;
+
+    public:
+        response_cache_t(const Json::Value& args);
+
+        // NOTE: Thread-safe, as the configuration is never modified.
+        bool
+        eligible(const api::event_t& event) const;
+
+        bool
+        lookup(const std::string& key,
+               chunk_list_t& response);
+
+        void
+        insert(const std::string& key,
+               const chunk_list_t& response);
+
+        // Wraps the upstream so that the response would be cached on success.
+        boost::shared_ptr<api::stream_t>
+        record(const std::string& key,
+               const boost::shared_ptr<api::stream_t>& upstream);
+
+        Json::Value
+        info();
+
+    public:
+        // The maximum size of a single cached response.
+        size_t
+        limit() const {
+            return m_budget / 4;
+        }
+
+    private:
+        void
+        evict();
+
+    private:
+        std::set<std::string> m_events;
+
+        // Time to live, in seconds.
+        double m_ttl;
+
+        // Memory budget, in bytes.
+        size_t m_budget;
+
+        struct entry_t {
+            chunk_list_t response;
+            double expires_at;
+            size_t size;
+            std::list<std::string>::iterator position;
+        };
+
+#if BOOST_VERSION >= 103600
+        typedef boost::unordered_map<
+#else
+        typedef std::map<
+#endif
+            std::string,
+            entry_t
+        > entry_map_t;
+
+        entry_map_t m_entries;
+
+        // Most recently used keys go first.
+        std::list<std::string> m_lru;
+
+        size_t m_size;
+
+        boost::mutex m_mutex;
+
+        // Statistics.
+        std::atomic<uint64_t> m_hits;
+        std::atomic<uint64_t> m_misses;
+        std::atomic<uint64_t> m_evictions;
+};
+
+}} // namespace cocaine::engine
+
+#endif
@@ -88,6 +88,105 @@ namespace rpc {
             /* session */ uint64_t
         > tuple_type;
     };
+
+    // NOTE: Grants the peer a permission to send the specified number of
+    // additional chunks for the session, see the "credits" slave feature.
+    struct credit {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* session */ uint64_t,
+            /* credits */ uint64_t
+        > tuple_type;
+    };
+
+    struct cancel {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* session */ uint64_t
+        > tuple_type;
+    };
+
+    struct handshake {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* features */ std::vector<std::string>
+        > tuple_type;
+    };
+
+    // NOTE: Sent by the slave right after the handshake, announcing its event
+    // handlers. The handler index in this list can then be used to invoke it.
+    struct handlers {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* events */ std::vector<std::string>
+        > tuple_type;
+    };
+
+    struct invoke_id {
+        typedef tags::rpc_tag tag;
+        
+        typedef boost::mpl::list<
+            /* session */ uint64_t,
+            /* handler */ uint32_t
+        > tuple_type;
+    };
+
+    // NOTE: Announces a chunk which has been written to the shared memory ring
+    // instead of the bus, see the "shm" slave feature. The chunk is the next
+    // specified number of bytes in the ring.
+    struct chunk_ref {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* session */ uint64_t,
+            /* size */    uint64_t
+        > tuple_type;
+    };
+
+    // NOTE: Announces a chunk which has been passed as a sealed memory file
+    // descriptor through the descriptor channel, see the "fd" slave feature.
+    struct chunk_fd {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* session */ uint64_t,
+            /* size */    uint64_t
+        > tuple_type;
+    };
+
+    // NOTE: A chunk compressed with LZ4, see the "lz4" slave feature.
+    struct chunk_lz4 {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* session */  uint64_t,
+            /* original */ uint64_t,
+            /* data */     std::string
+        > tuple_type;
+    };
+
+    // NOTE: Batches carry a sequence of complete RPC messages, each of them
+    // being a pair of the message type and the packed message tuple.
+
+    struct invoke_batch {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* frames */ std::vector<std::pair<int, std::string>>
+        > tuple_type;
+    };
+
+    struct reply_batch {
+        typedef tags::rpc_tag tag;
+
+        typedef boost::mpl::list<
+            /* frames */ std::vector<std::pair<int, std::string>>
+        > tuple_type;
+    };
 }
 
 namespace control {
@@ -98,6 +197,10 @@ namespace control {
     struct terminate {
         typedef tags::control_tag tag;
     };
+
+    struct drain {
+        typedef tags::control_tag tag;
+    };
 }
 
 template<>
@@ -109,7 +212,17 @@ struct protocol<tags::rpc_tag> {
         rpc::invoke,
         rpc::chunk,
         rpc::error,
-        rpc::choke
+        rpc::choke,
+        rpc::handshake,
+        rpc::invoke_batch,
+        rpc::reply_batch,
+        rpc::credit,
+        rpc::cancel,
+        rpc::handlers,
+        rpc::invoke_id,
+        rpc::chunk_ref,
+        rpc::chunk_fd,
+        rpc::chunk_lz4
     >::type type;
 };
 
@@ -117,7 +230,8 @@ template<>
 struct protocol<tags::control_tag> {
     typedef boost::mpl::list<
         control::status,
-        control::terminate
+        control::terminate,
+        control::drain
     >::type type;
 };
 
@@ -24,23 +24,41 @@
 #include "cocaine/common.hpp"
 #include "cocaine/birth_control.hpp"
 #include "cocaine/channel.hpp"
+#include "cocaine/rpc.hpp"
 #include "cocaine/slave.hpp"
+#include "cocaine/spool.hpp"
 
 #include "cocaine/api/event.hpp"
 
-#include <sstream>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
 
 namespace cocaine { namespace engine {
 
 struct session_t:
     public birth_control<session_t>
 {
+    typedef std::vector<
+        std::pair<int, std::string>
+    > message_cache_t;
+
+public:
     session_t(uint64_t id,
               const api::event_t& event,
-              const boost::shared_ptr<api::stream_t>& upstream);
+              const boost::shared_ptr<api::stream_t>& upstream,
+              unsigned long window = 0,
+              const boost::shared_ptr<spool_t>& spool = boost::shared_ptr<spool_t>());
+
+    ~session_t();
 
+    // NOTE: If the cached messages were already delivered to the slave by other
+    // means, like a batched invocation, then the flush should be suppressed.
     void
-    attach(slave_t * const slave);
+    attach(slave_t * const slave,
+           uint64_t tag,
+           bool flush = true);
 
     void
     detach();
@@ -49,6 +67,115 @@ struct session_t:
     bool
     send(Args&&... args);
 
+    // Returns a copy of the messages sent by the client before the session
+    // has been attached to a slave.
+    message_cache_t
+    cache();
+
+    // Replaces the session ID, which is always the first element of the packed
+    // message tuple, keeping the rest of the message intact.
+    static
+    std::string
+    rebind(const std::string& frame,
+           uint64_t tag);
+
+    static
+    std::string
+    rebind(const char * data,
+           size_t size,
+           uint64_t tag);
+
+    // The session tag on the slave it is attached to.
+    uint64_t
+    tag() const {
+        return m_tag;
+    }
+
+    // Checks whether the client has completed the request, i.e. the whole
+    // request is in the message cache.
+    bool
+    complete();
+
+    // Checks whether the request is complete and nothing has been spilled, so
+    // that it can be copied with cache() cheaply. The spilled requests are only
+    // streamed to the slave they're attached to, and never batched or hedged.
+    bool
+    cached();
+
+    // Marks the session as abandoned by the client, so that its results
+    // would be discarded. Only accessed from the engine thread.
+    void
+    cancel() {
+        m_cancelled = true;
+    }
+
+    bool
+    cancelled() const {
+        return m_cancelled;
+    }
+
+    // Latency tracking
+
+    // NOTE: Marks the session as dispatched to a slave. Only accessed from the
+    // engine thread, as well as the reply tracking below.
+    void
+    dispatch(int64_t timestamp) {
+        m_dispatched = timestamp;
+    }
+
+    int64_t
+    dispatched() const {
+        return m_dispatched;
+    }
+
+    // Returns true only for the first reply chunk of the session.
+    bool
+    respond() {
+        if(m_responded) {
+            return false;
+        }
+
+        return m_responded = true;
+    }
+
+    // Flow control
+
+    // Grants the client a permission to send more chunks to the slave.
+    void
+    grant(uint64_t credits);
+
+    // NOTE: Whether the client can send more chunks without them being held
+    // back in the session backlog. Sending never blocks either way.
+    bool
+    writable();
+
+    // NOTE: Invokes the callback once the session becomes writable, which might
+    // happen right away in the calling thread or later on in the engine thread.
+    void
+    notify(const boost::function<void()>& callback);
+
+    // Accounts a chunk delivered to the upstream, and returns the number of
+    // credits which should be granted back to the slave, if any.
+    uint64_t
+    consume();
+
+    // NOTE: Withholds the credits from the slave until the upstream drains, and
+    // returns true if nothing was withheld before, i.e. the upstream has to be
+    // watched. Only accessed from the engine thread, as well as restore().
+    bool
+    withhold(uint64_t credits) {
+        const bool first = !m_withheld;
+        m_withheld += credits;
+        return first;
+    }
+
+    uint64_t
+    restore() {
+        const uint64_t credits = m_withheld;
+        m_withheld = 0;
+        return credits;
+    }
+
 public:
     // Session ID.
     const uint64_t id;
@@ -59,40 +186,138 @@ public:
     // Client's upstream for result delivery.
     const boost::shared_ptr<api::stream_t> upstream;
 
+    // Session creation time, on the monotonic clock, in nanoseconds.
+    const int64_t birthstamp;
+
 private:
-    typedef std::vector<
-        std::pair<int, std::string>
-    > message_cache_t;
+    // NOTE: Caches the message within the engine spool budget, or spills it.
+    // Must be called with the session lock held.
+    void
+    store(int type,
+          const char * data,
+          size_t size);
 
+    // NOTE: Drops the cached messages and returns their bytes to the spool.
+    // Must be called with the session lock held.
+    void
+    drop();
+
+    // NOTE: Holds the message back until the slave grants more credits. Must be
+    // called with the session lock held.
+    void
+    defer(int type,
+          const char * data,
+          size_t size);
+
+    // NOTE: Sends the held back messages as far as the credits allow, and returns
+    // the callbacks to invoke if the session has become writable. Must be called
+    // with the session lock held, the callbacks must be invoked without it.
+    std::vector<boost::function<void()>>
+    release();
+
+    // The number of the held back messages.
+    size_t
+    held() const {
+        return m_backlog ? m_backlog->size() : 0;
+    }
+
+private:
     // Message cache.
     message_cache_t m_cache;
     boost::mutex m_mutex;
 
-    // Responsible slave.
+    // NOTE: The cached messages beyond the engine spool budget are spilled to
+    // a file. Once the session has started spilling, all its further messages
+    // are spilled too, so that their order is kept.
+    const boost::shared_ptr<spool_t> m_spool;
+    std::unique_ptr<spill_t> m_spill;
+
+    // The size of the messages cached in memory.
+    size_t m_cached;
+
+    // Whether the client has closed the downstream before the attachment.
+    bool m_complete;
+
+    // Flow control window.
+    const unsigned long m_window;
+
+    // NOTE: When the client runs out of credits, its messages are held back in
+    // the backlog until either the slave grants some more or the flow control is
+    // lifted for the session. The client is never blocked, but it is notified
+    // once it can send again without growing the backlog, and its chunks are
+    // rejected once the backlog has grown to the window size. The backlog is
+    // only allocated once something is held back, as a deque allocates right
+    // away and most sessions never need it.
+    bool m_throttled;
+    uint64_t m_credits;
+    std::unique_ptr<std::deque<std::pair<int, std::string>>> m_backlog;
+    std::vector<boost::function<void()>> m_waiters;
+
+    // Chunks delivered to the upstream since the last grant, and the credits
+    // withheld from the slave while the upstream was not writable.
+    uint64_t m_delivered;
+    uint64_t m_withheld;
+
+    // Whether the client has abandoned the session.
+    bool m_cancelled;
+
+    // Dispatch time and whether the slave has replied anything yet.
+    int64_t m_dispatched;
+    bool m_responded;
+
+    // Responsible slave and the session tag on it.
     slave_t * m_slave;
+    uint64_t m_tag;
 };
 
 template<class Event, typename... Args>
 bool
 session_t::send(Args&&... args) {
+    const bool chunk = std::is_same<Event, io::rpc::chunk>::value;
+
     boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    // NOTE: Everything sent after a held back message is held back as well, so
+    // that the message order is kept.
+    if(m_throttled && (held() || (chunk && !m_credits))) {
+        // NOTE: The client which keeps pushing regardless of writable() is only
+        // allowed to hold back a window worth of chunks.
+        if(chunk && held() >= m_window) {
+            throw cocaine::error_t("the session backlog is full");
+        }
+
+        msgpack::sbuffer buffer;
+
+        io::type_traits<
+            typename io::event_traits<Event>::tuple_type
+        >::pack(buffer, id, std::forward<Args>(args)...);
+
+        defer(io::event_traits<Event>::id, buffer.data(), buffer.size());
+
+        return true;
+    }
+
+    if(chunk && m_throttled) {
+        --m_credits;
+    }
     
     if(!m_slave) {
-        std::ostringstream buffer;
+        msgpack::sbuffer buffer;
 
         io::type_traits<
             typename io::event_traits<Event>::tuple_type
         >::pack(buffer, id, std::forward<Args>(args)...);
 
-        m_cache.emplace_back(
-            io::event_traits<Event>::id,
-            buffer.str()
-        );
+        store(io::event_traits<Event>::id, buffer.data(), buffer.size());
+
+        if(std::is_same<Event, io::rpc::choke>::value) {
+            m_complete = true;
+        }
 
         return true;
     }
 
-    return m_slave->send<Event>(id, std::forward<Args>(args)...);    
+    return m_slave->send<Event>(m_tag, std::forward<Args>(args)...);    
 }
 
 }}
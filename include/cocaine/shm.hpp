@@ -0,0 +1,146 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_SHM_HPP
+#define COCAINE_SHM_HPP
+
+#include "cocaine/common.hpp"
+
+#include <atomic>
+
+#include <boost/thread/mutex.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: A single-producer single-consumer byte ring placed in the shared memory.
+// The positions only ever grow, so that the ring is full when the producer's
+// tail is a capacity ahead of the consumer's head. The payloads are announced to
+// the consumer by the messages on the bus, so the ring itself doesn't carry any
+// framing and has no wakeup mechanism of its own.
+
+class ring_t {
+    public:
+        struct header_t {
+            uint64_t magic;
+            uint64_t capacity;
+
+            // NOTE: The positions are kept on separate cache lines, as they're
+            // written by the different processes.
+            alignas(64) std::atomic<uint64_t> head;
+            alignas(64) std::atomic<uint64_t> tail;
+        };
+
+        static const uint64_t magic = 0x636F6361696E6531ULL;
+
+    public:
+        ring_t(void * base,
+               size_t capacity);
+
+        // NOTE: Producer side. Returns false if there's not enough space, in
+        // which case nothing is written. Throws if the positions are corrupted.
+        bool
+        write(const char * data,
+              size_t size);
+
+        // NOTE: Consumer side. Returns the pointer to the next size bytes if they
+        // are contiguous in the ring, or NULL if they're wrapped around, so that
+        // they have to be copied. Throws if the producer hasn't written them or
+        // the positions are corrupted.
+        const char*
+        front(size_t size) const;
+
+        void
+        read(char * buffer,
+             size_t size) const;
+
+        void
+        consume(size_t size);
+
+        size_t
+        capacity() const {
+            return m_capacity;
+        }
+
+    private:
+        // NOTE: Validates the positions and returns the current head.
+        uint64_t
+        check(size_t size) const;
+
+    private:
+        header_t * const m_header;
+        char * const m_data;
+        const size_t m_capacity;
+};
+
+// NOTE: A pair of rings shared with a slave process, one in each direction, in
+// a file named after the slave in the engines runtime directory. The engine is
+// the only producer for the outbound ring, but the chunks are pushed from the
+// driver threads, so they have to lock the channel to keep the ring in the same
+// order as the announcements on the bus.
+
+class shm_t:
+    public boost::noncopyable
+{
+    public:
+        // The smallest chunk worth passing through the ring.
+        static const size_t threshold = 4096;
+
+    public:
+        shm_t(const std::string& path,
+              size_t capacity);
+
+        ~shm_t();
+
+        ring_t&
+        outbound() {
+            return m_outbound;
+        }
+
+        ring_t&
+        inbound() {
+            return m_inbound;
+        }
+
+        void
+        lock() {
+            m_mutex.lock();
+        }
+
+        void
+        unlock() {
+            m_mutex.unlock();
+        }
+
+    private:
+        const std::string m_path;
+        const size_t m_size;
+
+        int m_fd;
+        char * m_base;
+
+        ring_t m_outbound,
+               m_inbound;
+
+        boost::mutex m_mutex;
+};
+
+}} // namespace cocaine::engine
+
+#endif
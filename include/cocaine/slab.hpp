@@ -0,0 +1,168 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_SLAB_HPP
+#define COCAINE_SLAB_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/json.hpp"
+
+#include <boost/thread/mutex.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: A size-class free list allocator for the per-request objects, like the
+// sessions and their downstreams, which are allocated by the driver threads and
+// freed by the engine thread. Blocks are carved from large chunks and recycled,
+// so that in the steady state the global allocator is never called. The chunks
+// are only released when the slab itself is destroyed.
+
+class slab_t:
+    public boost::noncopyable
+{
+    public:
+        slab_t();
+        ~slab_t();
+
+        void*
+        allocate(size_t size);
+
+        void
+        deallocate(void * ptr,
+                   size_t size);
+
+        Json::Value
+        info() const;
+
+    private:
+        struct block_t {
+            block_t * next;
+        };
+
+        // NOTE: Size classes are powers of two, starting with the minimum one.
+        // Larger blocks go straight to the global allocator.
+        static const size_t minimum = 64;
+        static const size_t classes = 5;
+        static const size_t chunk_size = 64 * 1024;
+
+        static
+        size_t
+        index(size_t size);
+
+    private:
+        // NOTE: Only the blocks returned by deallocate() are kept in the free
+        // lists, the fresh ones are carved from the latest chunk of their size
+        // class on demand.
+        block_t * m_free[classes];
+
+        char * m_cursor[classes];
+        char * m_limit[classes];
+
+        std::vector<char*> m_chunks;
+
+        // Statistics.
+        uint64_t m_allocated,
+                 m_recycled,
+                 m_oversized;
+
+        mutable boost::mutex m_mutex;
+};
+
+// NOTE: Standard allocator interface for the slab, suitable for allocate_shared(),
+// which places the object and its reference counter into a single slab block. The
+// allocator keeps the slab alive, so the objects can safely outlive the engine.
+
+template<class T>
+struct slab_allocator {
+    typedef T value_type;
+    typedef T * pointer;
+    typedef const T * const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<class U>
+    struct rebind {
+        typedef slab_allocator<U> other;
+    };
+
+    slab_allocator(const boost::shared_ptr<slab_t>& slab_):
+        slab(slab_)
+    { }
+
+    template<class U>
+    slab_allocator(const slab_allocator<U>& other):
+        slab(other.slab)
+    { }
+
+    pointer
+    allocate(size_type n,
+             const void * = 0)
+    {
+        return static_cast<pointer>(slab->allocate(n * sizeof(T)));
+    }
+
+    void
+    deallocate(pointer ptr,
+               size_type n)
+    {
+        slab->deallocate(ptr, n * sizeof(T));
+    }
+
+    void
+    construct(pointer ptr,
+              const_reference value)
+    {
+        new(ptr) T(value);
+    }
+
+    void
+    destroy(pointer ptr) {
+        ptr->~T();
+    }
+
+    size_type
+    max_size() const {
+        return static_cast<size_type>(-1) / sizeof(T);
+    }
+
+    boost::shared_ptr<slab_t> slab;
+};
+
+template<class T, class U>
+bool
+operator==(const slab_allocator<T>& lhs,
+           const slab_allocator<U>& rhs)
+{
+    return lhs.slab == rhs.slab;
+}
+
+template<class T, class U>
+bool
+operator!=(const slab_allocator<T>& lhs,
+           const slab_allocator<U>& rhs)
+{
+    return lhs.slab != rhs.slab;
+}
+
+}} // namespace cocaine::engine
+
+#endif
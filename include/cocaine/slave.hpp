@@ -24,10 +24,23 @@
 #include "cocaine/common.hpp"
 #include "cocaine/asio.hpp"
 #include "cocaine/engine.hpp"
+#include "cocaine/memfd.hpp"
+#include "cocaine/rpc.hpp"
+#include "cocaine/shm.hpp"
 #include "cocaine/unique_id.hpp"
+#include "cocaine/symbol.hpp"
+
+#include <atomic>
+
+#include <unistd.h>
 
 namespace cocaine { namespace engine {
 
+namespace detail {
+    template<class Event>
+    struct transport;
+}
+
 class slave_t:
     public boost::noncopyable
 {
@@ -39,31 +52,113 @@ class slave_t:
             dead
         };
 
+        // NOTE: Optional protocol extensions advertised by the slave in the
+        // handshake message. Slaves which never send it support none of them.
+        enum features: int {
+            batching     = 1 << 0,
+            credits      = 1 << 1,
+            cancellation = 1 << 2,
+            shm          = 1 << 3,
+            fd           = 1 << 4,
+            lz4          = 1 << 5
+        };
+
     public:
         slave_t(context_t& context,
-                const manifest_t& manifest,
-                const profile_t& profile,
+                const boost::shared_ptr<const manifest_t>& manifest,
+                const boost::shared_ptr<const profile_t>& profile,
+                unsigned int generation,
+                const std::string& path,
                 engine_t& engine);
 
         ~slave_t();
 
+        // NOTE: Reserves a slot for a new session and returns its tag, which
+        // identifies the session on the wire. The session must be assigned to
+        // the slave with this tag afterwards.
+        uint64_t
+        acquire();
+
+        // Returns a slot which has been reserved, but is not going to be assigned.
+        void
+        discard(uint64_t tag);
+
         void
-        assign(boost::shared_ptr<session_t>&& session);
+        assign(boost::shared_ptr<session_t>&& session,
+               uint64_t tag,
+               bool flush = true);
        
         void
         on_ping();
 
         void
-        on_chunk(uint64_t session_id,
-                 const std::string& message);
+        on_handshake(const std::vector<std::string>& features);
 
         void
-        on_error(uint64_t session_id,
+        on_handlers(const std::vector<std::string>& events);
+
+        // NOTE: Looks up the handler index announced by the slave for the event,
+        // if any. Events without one have to be invoked by name.
+        bool
+        handler(const symbol_t& event,
+                uint32_t& index) const;
+
+        void
+        on_chunk(uint64_t tag,
+                 const char * data,
+                 size_t size);
+
+        void
+        on_chunk_ref(uint64_t tag,
+                     uint64_t size);
+
+        void
+        on_chunk_fd(uint64_t tag,
+                    uint64_t size);
+
+        void
+        on_chunk_lz4(uint64_t tag,
+                     uint64_t original,
+                     const std::string& data);
+
+        void
+        on_error(uint64_t tag,
                  error_code code,
                  const std::string& message);
 
         void
-        on_choke(uint64_t session_id);
+        on_choke(uint64_t tag);
+
+        void
+        on_credit(uint64_t tag,
+                  uint64_t credits);
+
+        bool
+        cancel(const boost::shared_ptr<session_t>& session);
+
+        // NOTE: Grants the slave the credits withheld from it while the session
+        // upstream was not writable.
+        bool
+        resume(const boost::shared_ptr<session_t>& session);
+
+        // NOTE: Applies the new profile limits and re-arms the timers. The slave
+        // process itself is not affected.
+        void
+        reconfigure(const boost::shared_ptr<const profile_t>& profile);
+
+        // NOTE: Retiring slaves don't accept new sessions and deactivate as soon
+        // as the current ones are completed.
+        void
+        retire();
+
+        // NOTE: Fails all the sessions assigned to the slave, so that it could be
+        // dropped from the pool right away, e.g. when it has broken the protocol.
+        void
+        abort(error_code code,
+              const std::string& reason);
+
+        size_t
+        resident() const;
 
         template<class Event, typename... Args>
         bool
@@ -94,7 +189,37 @@ class slave_t:
 
         size_t
         load() const {
-            return m_sessions.size();
+            return m_load;
+        }
+
+        bool
+        retiring() const {
+            return m_retiring;
+        }
+
+        // NOTE: Whether the slave has died without ever becoming active, which
+        // means that the app is likely to be broken.
+        bool
+        failed() const {
+            return m_failed;
+        }
+
+        // NOTE: The app version this slave has been spawned for, the engine
+        // dispatches sessions only to the slaves of the current generation.
+        unsigned int
+        generation() const {
+            return m_generation;
+        }
+
+        // The total number of sessions assigned to this slave.
+        uint64_t
+        processed() const {
+            return m_processed;
+        }
+
+        bool
+        supports(features feature) const {
+            return (m_features.load(std::memory_order_acquire) & feature) != 0;
         }
 
     private:
@@ -107,6 +232,30 @@ class slave_t:
         void
         rearm();
 
+        struct slot_t {
+            uint64_t tag;
+            boost::shared_ptr<session_t> session;
+        };
+
+        slot_t*
+        find(uint64_t tag);
+
+        void
+        erase(slot_t& slot);
+
+        void
+        cancel(slot_t& slot);
+
+        void
+        grow(size_t size);
+
+        // Called when the last session has been completed.
+        void
+        release();
+
+        void
+        deactivate();
+
         void
         terminate();
  
@@ -114,8 +263,8 @@ class slave_t:
         context_t& m_context;
         std::unique_ptr<logging::log_t> m_log;
 
-        const manifest_t& m_manifest;
-        const profile_t& m_profile;
+        const boost::shared_ptr<const manifest_t> m_manifest;
+        boost::shared_ptr<const profile_t> m_profile;
 
         // Controlling engine.
         engine_t& m_engine;
@@ -123,9 +272,24 @@ class slave_t:
         // Slave ID.
         const unique_id_t m_id;
 
+        // App version.
+        const unsigned int m_generation;
+
         // Current slave state.
         state_t m_state;
 
+        // NOTE: Negotiated protocol extensions. Published by the engine thread once
+        // the transports below are set up, and read by the driver threads, which
+        // may only use a transport if its feature is supported.
+        std::atomic<int> m_features;
+
+        // Activation failure.
+        bool m_failed;
+
+        // Recycling.
+        uint64_t m_processed;
+        bool m_retiring;
+
         // Slave health monitoring.
         ev::timer m_heartbeat_timer;
         ev::timer m_idle_timer;
@@ -133,28 +297,138 @@ class slave_t:
         // Actual slave process handle.    
         std::unique_ptr<api::handle_t> m_handle;
 
-#if BOOST_VERSION >= 103600
-        typedef boost::unordered_map<
-#else
-        typedef std::map<
-#endif
-            uint64_t,
-            boost::shared_ptr<session_t>
-        > session_map_t;
+        // NOTE: Current sessions, indexed by the lower half of their tags. The
+        // upper half is incremented every time the slot is reused, so that late
+        // messages for the previous sessions are never misdelivered.
+        std::vector<slot_t> m_slots;
+        std::vector<uint32_t> m_free;
+
+        // The number of occupied slots.
+        size_t m_load;
 
-        // Current sessions.
-        session_map_t m_sessions;
+        // NOTE: Handler indices announced by the slave, indexed by the event
+        // symbol IDs, offset by one so that zero means no handler.
+        std::vector<uint32_t> m_handlers;
+
+        // Shared memory rings for the large chunks, if the slave supports them.
+        std::unique_ptr<shm_t> m_shm;
+
+        // Descriptor channel for the huge chunks, if the slave supports it.
+        std::unique_ptr<fd_channel_t> m_fds;
+
+        // NOTE: The compression threshold is read by the driver threads, while
+        // the profile might be replaced by the engine thread.
+        std::atomic<size_t> m_compression_threshold;
+
+        template<class Event>
+        friend struct detail::transport;
 };
 
+namespace detail {
+    template<class Event>
+    struct transport {
+        template<typename... Args>
+        static
+        bool
+        send(slave_t& slave,
+             Args&&... args)
+        {
+            return slave.m_engine.send<Event>(
+                slave.m_id,
+                std::forward<Args>(args)...
+            );
+        }
+    };
+
+    // NOTE: Large chunks are written to the shared memory ring, if the slave
+    // has one and there's enough space in it, and only announced on the bus.
+    // Huge chunks are passed as sealed memory files, so that their transfer
+    // cost doesn't depend on their size.
+    template<>
+    struct transport<io::rpc::chunk> {
+        static
+        bool
+        send(slave_t& slave,
+             uint64_t tag,
+             const std::string& chunk)
+        {
+            if(slave.supports(slave_t::features::fd) && chunk.size() >= slave.m_fds->threshold()) {
+                boost::unique_lock<fd_channel_t> lock(*slave.m_fds);
+
+                if(slave.m_fds->connected() && pass(*slave.m_fds, chunk)) {
+                    return slave.m_engine.send<io::rpc::chunk_fd>(
+                        slave.m_id,
+                        tag,
+                        static_cast<uint64_t>(chunk.size())
+                    );
+                }
+
+                // NOTE: Otherwise, for example if the descriptor channel is full,
+                // the chunk is sent the other way, as nothing has been passed.
+            }
+
+            if(slave.supports(slave_t::features::lz4) &&
+               chunk.size() >= slave.m_compression_threshold)
+            {
+                std::string packed;
+
+                if(slave.m_engine.compressor().compress(chunk.data(), chunk.size(), packed)) {
+                    return slave.m_engine.send<io::rpc::chunk_lz4>(
+                        slave.m_id,
+                        tag,
+                        static_cast<uint64_t>(chunk.size()),
+                        packed
+                    );
+                }
+            }
+
+            if(!slave.supports(slave_t::features::shm) || chunk.size() < shm_t::threshold) {
+                return slave.m_engine.send<io::rpc::chunk>(slave.m_id, tag, chunk);
+            }
+
+            boost::unique_lock<shm_t> lock(*slave.m_shm);
+
+            if(!slave.m_shm->outbound().write(chunk.data(), chunk.size())) {
+                return slave.m_engine.send<io::rpc::chunk>(slave.m_id, tag, chunk);
+            }
+
+            return slave.m_engine.send<io::rpc::chunk_ref>(
+                slave.m_id,
+                tag,
+                static_cast<uint64_t>(chunk.size())
+            );
+        }
+
+        // NOTE: Passes a sealed copy of the chunk to the slave, returns false if
+        // it couldn't be passed. Must be called with the descriptor channel locked
+        // and followed by the announcement on success.
+        static
+        bool
+        pass(fd_channel_t& channel,
+             const std::string& chunk)
+        {
+            const int fd = memfd_t::create(chunk.data(), chunk.size());
+
+            if(fd == -1) {
+                return false;
+            }
+
+            const bool success = channel.send(fd);
+
+            // NOTE: The slave has its own copy of the descriptor now.
+            ::close(fd);
+
+            return success;
+        }
+    };
+}
+
 template<class Event, typename... Args>
 bool
 slave_t::send(Args&&... args) {
     BOOST_ASSERT(m_state == state_t::active);
 
-    return m_engine.send<Event>(
-        m_id,
-        std::forward<Args>(args)...
-    );
+    return detail::transport<Event>::send(*this, std::forward<Args>(args)...);
 }
 
 }} // namespace cocaine::engine
@@ -0,0 +1,138 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_SPOOL_HPP
+#define COCAINE_SPOOL_HPP
+
+#include "cocaine/common.hpp"
+#include "cocaine/json.hpp"
+
+#include <atomic>
+
+#include <boost/function.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: Accounts the bytes the clients have sent for the sessions which are not
+// yet attached to a slave. Up to the memory budget, they're kept in the session
+// caches, and the rest is spilled into anonymous files in the spool directory,
+// so that a deep queue of large requests doesn't exhaust the memory.
+
+class spool_t:
+    public boost::noncopyable
+{
+    public:
+        spool_t(const std::string& path,
+                size_t budget);
+
+        // Reserves the memory for a cached message. If the budget is exhausted,
+        // the message should be spilled instead.
+        bool
+        reserve(size_t size);
+
+        void
+        release(size_t size);
+
+        // Accounts the cached bytes, both in memory and spilled.
+        void
+        enqueue(size_t size);
+
+        void
+        dequeue(size_t size);
+
+        // Creates an unlinked spill file and returns its descriptor.
+        int
+        open();
+
+        void
+        resize(size_t budget) {
+            m_budget = budget;
+        }
+
+        size_t
+        pending() const {
+            return m_pending;
+        }
+
+        Json::Value
+        info() const;
+
+    private:
+        const std::string m_path;
+
+        std::atomic<size_t> m_budget,
+                            m_memory,
+                            m_pending;
+
+        // Statistics.
+        std::atomic<uint64_t> m_files,
+                              m_spilled;
+
+        friend class spill_t;
+};
+
+// NOTE: The spilled messages of a single session, appended to the file in order
+// and streamed back from a read-only mapping once the session is attached.
+
+class spill_t:
+    public boost::noncopyable
+{
+    public:
+        typedef boost::function<
+            void(int, const char*, size_t)
+        > visitor_type;
+
+    public:
+        explicit
+        spill_t(spool_t& spool);
+
+        ~spill_t();
+
+        void
+        append(int type,
+               const char * data,
+               size_t size);
+
+        void
+        visit(const visitor_type& visitor) const;
+
+        // The number of payload bytes in the file.
+        size_t
+        size() const {
+            return m_payload;
+        }
+
+    private:
+        struct header_t {
+            int32_t type;
+            uint32_t size;
+        };
+
+        spool_t& m_spool;
+
+        const int m_fd;
+
+        size_t m_size,
+               m_payload;
+};
+
+}} // namespace cocaine::engine
+
+#endif
@@ -0,0 +1,115 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef COCAINE_SYMBOL_HPP
+#define COCAINE_SYMBOL_HPP
+
+#include "cocaine/common.hpp"
+
+#include <iosfwd>
+
+namespace cocaine {
+
+// NOTE: An event name, which might have been interned. The interned symbols share
+// the same immutable entry with a small process-wide numeric ID, which can be used
+// as an index instead of hashing and comparing the names. Constructing a symbol
+// only looks the name up, without locking or allocating anything, and the names
+// are only interned explicitly, when the slaves announce their handlers, so that
+// the drivers which emit arbitrary event names wouldn't fill the table. The table
+// is bounded, once it's full, the new names stay dynamic and have no ID. Each app
+// may only add a limited number of names, see engine_t::intern().
+
+class symbol_t {
+    public:
+        static const unsigned int dynamic = static_cast<unsigned int>(-1);
+
+    public:
+        symbol_t(const std::string& name);
+        symbol_t(const char * name);
+
+        // NOTE: Adds the name to the symbol table, if it's not full yet.
+        static
+        symbol_t
+        intern(const std::string& name);
+
+        operator const std::string&() const {
+            return str();
+        }
+
+        const std::string&
+        str() const {
+            return m_entry ? m_entry->name : m_name;
+        }
+
+        unsigned int
+        id() const {
+            return m_entry ? m_entry->id : dynamic;
+        }
+
+        bool
+        interned() const {
+            return m_entry != NULL;
+        }
+
+        bool
+        operator==(const symbol_t& other) const {
+            if(m_entry && other.m_entry) {
+                return m_entry == other.m_entry;
+            }
+
+            // NOTE: The name might have been interned after the dynamic symbol
+            // was constructed.
+            return str() == other.str();
+        }
+
+        bool
+        operator!=(const symbol_t& other) const {
+            return !(*this == other);
+        }
+
+        // The number of interned symbols.
+        static
+        size_t
+        count();
+
+    public:
+        struct entry_t {
+            std::string name;
+            unsigned int id;
+        };
+
+    private:
+        symbol_t(const entry_t * entry,
+                 const std::string& name);
+
+    private:
+        const entry_t * m_entry;
+
+        // NOTE: Only the dynamic symbols carry their own copy of the name.
+        std::string m_name;
+};
+
+std::ostream&
+operator<<(std::ostream& stream,
+           const symbol_t& symbol);
+
+} // namespace cocaine
+
+#endif
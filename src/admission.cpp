@@ -0,0 +1,231 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+
+#include "cocaine/admission.hpp"
+
+#include "cocaine/api/event.hpp"
+
+#include <ctime>
+
+#include <boost/functional/hash.hpp>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace {
+    int64_t
+    now() {
+        timespec ts;
+
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+    boost::shared_ptr<token_bucket_t>
+    bucket(const Json::Value& args) {
+        const double rate = args.get("rate", 0.0f).asDouble(),
+                     burst = args.get("burst", rate).asDouble();
+
+        if(rate <= 0.0f) {
+            throw configuration_error_t("admission rate must be positive");
+        }
+
+        if(burst < 1.0f) {
+            throw configuration_error_t("admission burst must be at least one request");
+        }
+
+        return boost::make_shared<token_bucket_t>(rate, burst);
+    }
+}
+
+// Token bucket
+
+token_bucket_t::token_bucket_t(double rate,
+                               double burst):
+    m_interval(static_cast<int64_t>(1e9 / rate)),
+    m_tolerance(static_cast<int64_t>(1e9 / rate * burst)),
+    m_tat(0),
+    m_admitted(0),
+    m_rejected(0)
+{ }
+
+bool
+token_bucket_t::consume() {
+    const int64_t timestamp = now();
+
+    int64_t tat = m_tat.load(std::memory_order_relaxed);
+
+    do {
+        const int64_t next = std::max(tat, timestamp) + m_interval;
+
+        if(next - timestamp > m_tolerance) {
+            ++m_rejected;
+            return false;
+        }
+
+        if(m_tat.compare_exchange_weak(tat, next)) {
+            break;
+        }
+    } while(true);
+
+    ++m_admitted;
+
+    return true;
+}
+
+void
+token_bucket_t::refund() {
+    const int64_t timestamp = now();
+
+    int64_t tat = m_tat.load(std::memory_order_relaxed);
+
+    // NOTE: The theoretical arrival time is never moved below now, as the bucket
+    // can't hold more than its burst no matter how many tokens are given back.
+    while(tat > timestamp) {
+        if(m_tat.compare_exchange_weak(tat, std::max(tat - m_interval, timestamp))) {
+            break;
+        }
+    }
+
+    --m_admitted;
+}
+
+// Admission control
+
+admission_t::admission_t(const Json::Value& args) {
+    const Json::Value& drivers(args["drivers"]);
+
+    if(!drivers.empty()) {
+        Json::Value::Members names(drivers.getMemberNames());
+
+        for(Json::Value::Members::const_iterator it = names.begin();
+            it != names.end();
+            ++it)
+        {
+            m_drivers.emplace(*it, bucket(drivers[*it]));
+        }
+    }
+
+    const Json::Value& clients(args["clients"]);
+
+    if(!clients.empty()) {
+        const unsigned int slots = clients.get("slots", 1024).asUInt();
+
+        if(slots == 0) {
+            throw configuration_error_t("admission client slot count must be positive");
+        }
+
+        m_clients.reserve(slots);
+
+        for(unsigned int i = 0; i < slots; ++i) {
+            m_clients.emplace_back(bucket(clients));
+        }
+    }
+}
+
+bool
+admission_t::admit(const api::event_t& event) {
+    token_bucket_t * const driver = this->driver(event);
+
+    if(driver && !driver->consume()) {
+        return false;
+    }
+
+    token_bucket_t * const client = this->client(event);
+
+    if(client && !client->consume()) {
+        // NOTE: The driver token has been taken for nothing, so give it back.
+        if(driver) {
+            driver->refund();
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+admission_t::refund(const api::event_t& event) {
+    token_bucket_t * const driver = this->driver(event);
+
+    if(driver) {
+        driver->refund();
+    }
+
+    token_bucket_t * const client = this->client(event);
+
+    if(client) {
+        client->refund();
+    }
+}
+
+token_bucket_t *
+admission_t::driver(const api::event_t& event) const {
+    if(m_drivers.empty() || event.source.empty()) {
+        return NULL;
+    }
+
+    bucket_map_t::const_iterator it(m_drivers.find(event.source));
+
+    return it != m_drivers.end() ? it->second.get() : NULL;
+}
+
+token_bucket_t *
+admission_t::client(const api::event_t& event) const {
+    if(m_clients.empty() || event.identity.empty()) {
+        return NULL;
+    }
+
+    return m_clients[boost::hash_value(event.identity) % m_clients.size()].get();
+}
+
+Json::Value
+admission_t::info() const {
+    Json::Value info(Json::objectValue);
+
+    for(bucket_map_t::const_iterator it = m_drivers.begin();
+        it != m_drivers.end();
+        ++it)
+    {
+        info["drivers"][it->first]["admitted"] = static_cast<Json::LargestUInt>(it->second->admitted());
+        info["drivers"][it->first]["rejected"] = static_cast<Json::LargestUInt>(it->second->rejected());
+    }
+
+    if(!m_clients.empty()) {
+        uint64_t admitted = 0,
+                 rejected = 0;
+
+        for(bucket_list_t::const_iterator it = m_clients.begin();
+            it != m_clients.end();
+            ++it)
+        {
+            admitted += (*it)->admitted();
+            rejected += (*it)->rejected();
+        }
+
+        info["clients"]["admitted"] = static_cast<Json::LargestUInt>(admitted);
+        info["clients"]["rejected"] = static_cast<Json::LargestUInt>(rejected);
+    }
+
+    return info;
+}
@@ -27,8 +27,10 @@
 #include "cocaine/manifest.hpp"
 #include "cocaine/profile.hpp"
 #include "cocaine/rpc.hpp"
+#include "cocaine/unique_id.hpp"
 
 #include "cocaine/api/driver.hpp"
+#include "cocaine/api/storage.hpp"
 
 #include "cocaine/traits/json.hpp"
 
@@ -43,25 +45,62 @@ using namespace cocaine::logging;
 
 namespace fs = boost::filesystem;
 
+namespace {
+    // NOTE: Every app version is deployed to its own directory next to the app
+    // directory, which is a symlink to the current version.
+    fs::path
+    version(const fs::path& link) {
+        return fs::path(cocaine::format("%s.%s", link.string(), unique_id_t().string()));
+    }
+}
+
 app_t::app_t(context_t& context,
              const std::string& name,
              const std::string& profile):
     m_context(context),
     m_log(new log_t(context, cocaine::format("app/%1%", name))),
-    m_manifest(new manifest_t(context, name)),
-    m_profile(new profile_t(context, profile))
+    m_running(false)
 {
-    fs::path path = fs::path(m_context.config.path.spool) / name;
+    boost::shared_ptr<const manifest_t> manifest(new manifest_t(context, name));
+    boost::shared_ptr<const profile_t> settings(new profile_t(context, profile));
+
+    fs::path link = fs::path(m_context.config.path.spool) / name,
+             path;
     
-    if(!fs::exists(path)) {
+    try {
+        if(fs::is_symlink(link) && fs::exists(link)) {
+            path = fs::read_symlink(link);
+        } else if(fs::is_directory(link)) {
+            // NOTE: The app has been deployed before the versions were kept in
+            // separate directories, so it's moved aside. No slaves are running
+            // at this point yet.
+            path = version(link);
+            fs::rename(link, path);
+            fs::create_symlink(path, link);
+        }
+    } catch(const fs::filesystem_error& e) {
+        throw configuration_error_t("unable to access the app directory - %s", e.what());
+    }
+
+    if(path.empty()) {
+        path = version(link);
+
         deploy(name, path.string());
+
+        try {
+            // NOTE: The symlink might be left dangling by a failed deployment.
+            fs::remove(link);
+            fs::create_symlink(path, link);
+        } catch(const fs::filesystem_error& e) {
+            throw configuration_error_t("unable to switch the app directory - %s", e.what());
+        }
     }
 
     m_control.reset(new io::unique_channel_t(context, ZMQ_PAIR));
 
     std::string endpoint = cocaine::format(
         "inproc://%s",
-        m_manifest->name
+        manifest->name
     );
 
     try { 
@@ -74,8 +113,9 @@ app_t::app_t(context_t& context,
     m_engine.reset(
         new engine_t(
             m_context,
-            *m_manifest,
-            *m_profile
+            manifest,
+            settings,
+            path.string()
         )
     );
 }
@@ -94,22 +134,25 @@ app_t::start() {
 
     COCAINE_LOG_INFO(m_log, "starting the engine");
 
-    if(!m_manifest->drivers.empty()) {
+    // NOTE: The drivers are configured by the current app version.
+    const boost::shared_ptr<const manifest_t> manifest = m_engine->manifest();
+
+    if(!manifest->drivers.empty()) {
         COCAINE_LOG_INFO(
             m_log,
             "starting %llu %s",
-            m_manifest->drivers.size(),
-            m_manifest->drivers.size() == 1 ? "driver" : "drivers"
+            manifest->drivers.size(),
+            manifest->drivers.size() == 1 ? "driver" : "drivers"
         );
 
         boost::format format("%s/%s");
 
-        for(config_t::component_map_t::const_iterator it = m_manifest->drivers.begin();
-            it != m_manifest->drivers.end();
+        for(config_t::component_map_t::const_iterator it = manifest->drivers.begin();
+            it != manifest->drivers.end();
             ++it)
         {
             try {
-                format % m_manifest->name % it->first;
+                format % manifest->name % it->first;
 
                 m_drivers.emplace(
                     it->first,
@@ -139,10 +182,12 @@ app_t::start() {
         }
     }
 
+    m_running = true;
+
     m_thread.reset(
         new boost::thread(
-            &engine_t::run,
-            boost::ref(*m_engine)
+            &app_t::run,
+            this
         )
     );
     
@@ -157,7 +202,12 @@ app_t::stop() {
 
     COCAINE_LOG_INFO(m_log, "stopping the engine");
     
-    m_control->send<control::terminate>();
+    // NOTE: A drained engine has already left its event loop, so there's
+    // nobody to receive the termination request, but the thread still has
+    // to be joined.
+    if(m_running) {
+        m_control->send<control::terminate>();
+    }
 
     m_thread->join();
     m_thread.reset();
@@ -169,29 +219,105 @@ app_t::stop() {
     m_drivers.clear();
 }
 
+void
+app_t::drain() {
+    if(!m_thread || !m_running) {
+        return;
+    }
+
+    COCAINE_LOG_INFO(m_log, "draining the engine");
+
+    m_control->send<control::drain>();
+}
+
+bool
+app_t::drained() const {
+    return !m_running;
+}
+
+namespace {
+    void
+    invalidate(const api::category_traits<api::storage_t>::ptr_type& cache,
+               const std::string& collection,
+               const std::string& name)
+    {
+        try {
+            cache->remove(collection, name);
+        } catch(const storage_error_t& e) {
+            // NOTE: The object might not have been cached at all.
+        }
+    }
+}
+
+void
+app_t::upgrade(const std::string& profile) {
+    if(drained()) {
+        throw cocaine::error_t("engine is not active");
+    }
+
+    COCAINE_LOG_INFO(m_log, "upgrading the app using the '%s' profile", profile);
+
+    const std::string name = m_engine->manifest()->name;
+
+    // NOTE: The cached copies are dropped, so that both the manifest and the
+    // profile are fetched from the core storage again.
+    auto cache = api::storage(m_context, "cache");
+
+    invalidate(cache, "manifests", name);
+    invalidate(cache, "profiles", profile);
+
+    boost::shared_ptr<const manifest_t> next_manifest(new manifest_t(m_context, name));
+    boost::shared_ptr<const profile_t> next_profile(new profile_t(m_context, profile));
+
+    // NOTE: The new version is deployed to a directory of its own, which is only
+    // made current by the engine once the new slaves have activated, so that
+    // a rollback leaves the current version intact.
+    const fs::path staging = version(fs::path(m_context.config.path.spool) / name);
+
+    try {
+        deploy(name, staging.string());
+
+        // NOTE: The drivers are bound to the engine and keep running, so changes to
+        // the driver configuration in the new manifest require an app restart.
+        m_engine->upgrade(next_manifest, next_profile, staging.string());
+    } catch(const cocaine::error_t&) {
+        boost::system::error_code code;
+
+        fs::remove_all(staging, code);
+
+        throw;
+    }
+}
+
+void
+app_t::reload(const std::string& profile) {
+    if(drained()) {
+        throw cocaine::error_t("engine is not active");
+    }
+
+    COCAINE_LOG_INFO(m_log, "reloading the '%s' profile", profile);
+
+    invalidate(api::storage(m_context, "cache"), "profiles", profile);
+
+    boost::shared_ptr<const profile_t> next_profile(new profile_t(m_context, profile));
+
+    m_engine->upgrade(m_engine->manifest(), next_profile, std::string());
+}
+
 Json::Value
 app_t::info() const {
     Json::Value info(Json::objectValue);
 
-    if(!m_thread) {
+    if(drained()) {
         info["error"] = "engine is not active";
         return info;
     }
 
-    m_control->send<control::status>();
+    // NOTE: The engine status is read from its latest snapshot, so that a busy
+    // engine wouldn't stall the node.
+    info = m_engine->info();
 
-    {
-        scoped_option<
-            options::receive_timeout
-        > option(*m_control, defaults::control_timeout);
-
-        if(!m_control->recv(info)) {
-            info["error"] = "engine is unresponsive";
-            return info;
-        }
-    }
-
-    info["profile"] = m_profile->name;
+    info["profile"] = m_engine->profile()->name;
 
     for(driver_map_t::const_iterator it = m_drivers.begin();
         it != m_drivers.end();
@@ -211,6 +337,28 @@ app_t::enqueue(const api::event_t& event,
     return m_engine->enqueue(event, upstream, mode);
 }
 
+void
+app_t::enqueue_async(const api::event_t& event,
+                     const boost::shared_ptr<api::stream_t>& upstream,
+                     const boost::function<void(const boost::shared_ptr<api::stream_t>&)>& callback)
+{
+    m_engine->enqueue_async(event, upstream, callback);
+}
+
+std::vector<boost::shared_ptr<api::stream_t>>
+app_t::enqueue_batch(const std::vector<std::pair<api::event_t, boost::shared_ptr<api::stream_t>>>& batch) {
+    return m_engine->enqueue_batch(batch);
+}
+
+void
+app_t::run() {
+    m_engine->run();
+
+    // NOTE: The engine thread exits once the engine has been either stopped
+    // or drained.
+    m_running = false;
+}
+
 void
 app_t::deploy(const std::string& name, 
               const std::string& path)
@@ -0,0 +1,414 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/coalescing.hpp"
+
+#include "cocaine/engine.hpp"
+#include "cocaine/session.hpp"
+
+#include <openssl/evp.h>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+// Flight
+
+flight_t::flight_t(const boost::shared_ptr<coalescer_t>& coalescer,
+                   const boost::shared_ptr<handle_t>& handle,
+                   const std::string& key):
+    m_coalescer(coalescer),
+    m_handle(handle),
+    m_key(key),
+    m_result(result_t::none),
+    m_code(invocation_error),
+    m_landed(false)
+{ }
+
+void
+flight_t::push(const char * chunk,
+               size_t size)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_log.emplace_back(chunk, size);
+    }
+
+    if(!broadcast()) {
+        land();
+
+        // NOTE: This makes the engine cancel the session.
+        throw cocaine::error_t("no subscribers left");
+    }
+}
+
+void
+flight_t::error(error_code code,
+                const std::string& message)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        m_result = result_t::error;
+        m_code = code;
+        m_message = message;
+    }
+
+    broadcast();
+    land();
+}
+
+void
+flight_t::close() {
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_result = result_t::close;
+    }
+
+    broadcast();
+    land();
+}
+
+void
+flight_t::bind(const boost::shared_ptr<session_t>& session) {
+    bool landed;
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        m_session = session;
+        landed = m_landed;
+    }
+
+    // NOTE: Either this or unsubscribe() sees the other one's change, so the
+    // session is cancelled at least once if the last subscriber has left.
+    if(landed) {
+        cancel(session);
+    }
+}
+
+bool
+flight_t::subscribe(const boost::shared_ptr<api::stream_t>& upstream) {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    if(m_landed) {
+        return false;
+    }
+
+    m_subscribers.push_back(boost::make_shared<subscriber_t>(upstream));
+
+    return true;
+}
+
+void
+flight_t::catch_up(const boost::shared_ptr<api::stream_t>& upstream) {
+    boost::shared_ptr<subscriber_t> subscriber;
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        for(subscriber_list_t::const_iterator it = m_subscribers.begin();
+            it != m_subscribers.end();
+            ++it)
+        {
+            if((*it)->upstream == upstream) {
+                subscriber = *it;
+                break;
+            }
+        }
+    }
+
+    if(subscriber && !deliver(*subscriber)) {
+        unsubscribe(upstream);
+    }
+}
+
+void
+flight_t::unsubscribe(const boost::shared_ptr<api::stream_t>& upstream) {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    subscriber_list_t::iterator it = m_subscribers.begin();
+
+    while(it != m_subscribers.end() && (*it)->upstream != upstream) {
+        ++it;
+    }
+
+    if(it == m_subscribers.end()) {
+        return;
+    }
+
+    m_subscribers.erase(it);
+
+    if(!m_subscribers.empty() || m_landed) {
+        return;
+    }
+
+    lock.unlock();
+
+    land();
+
+    boost::shared_ptr<session_t> session;
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        session = m_session.lock();
+    }
+
+    if(session) {
+        cancel(session);
+    }
+}
+
+bool
+flight_t::deliver(subscriber_t& subscriber) {
+    boost::unique_lock<boost::mutex> guard(subscriber.mutex);
+
+    if(subscriber.done) {
+        return true;
+    }
+
+    std::vector<const std::string*> chunks;
+
+    result_t result;
+    error_code code;
+    std::string message;
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        for(size_t i = subscriber.cursor; i < m_log.size(); ++i) {
+            chunks.push_back(&m_log[i]);
+        }
+
+        result = m_result;
+        code = m_code;
+        message = m_message;
+    }
+
+    try {
+        for(std::vector<const std::string*>::const_iterator it = chunks.begin();
+            it != chunks.end();
+            ++it)
+        {
+            subscriber.upstream->push((*it)->data(), (*it)->size());
+            ++subscriber.cursor;
+        }
+
+        switch(result) {
+            case result_t::none:
+                break;
+
+            case result_t::error:
+                subscriber.done = true;
+                subscriber.upstream->error(code, message);
+                break;
+
+            case result_t::close:
+                subscriber.done = true;
+                subscriber.upstream->close();
+                break;
+        }
+    } catch(...) {
+        subscriber.done = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool
+flight_t::broadcast() {
+    subscriber_list_t subscribers;
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        subscribers = m_subscribers;
+    }
+
+    subscriber_list_t failed;
+
+    for(subscriber_list_t::const_iterator it = subscribers.begin();
+        it != subscribers.end();
+        ++it)
+    {
+        if(!deliver(**it)) {
+            failed.push_back(*it);
+        }
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    for(subscriber_list_t::const_iterator it = failed.begin();
+        it != failed.end();
+        ++it)
+    {
+        m_subscribers.erase(std::find(m_subscribers.begin(), m_subscribers.end(), *it));
+    }
+
+    return !m_subscribers.empty();
+}
+
+void
+flight_t::land() {
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        if(m_landed) {
+            return;
+        }
+
+        m_landed = true;
+    }
+
+    const boost::shared_ptr<coalescer_t> coalescer(m_coalescer.lock());
+
+    if(coalescer) {
+        coalescer->forget(m_key, this);
+    }
+}
+
+void
+flight_t::cancel(const boost::shared_ptr<session_t>& session) {
+    boost::shared_lock<boost::shared_mutex> guard(m_handle->mutex);
+
+    if(m_handle->engine) {
+        m_handle->engine->cancel(session);
+    }
+}
+
+// Coalescer
+
+coalescer_t::coalescer_t(const boost::shared_ptr<handle_t>& handle,
+                         const Json::Value& args):
+    m_handle(handle),
+    m_started(0),
+    m_joined(0)
+{
+    const Json::Value events(args["events"]);
+
+    if(!events.isNull() && !events.isArray()) {
+        throw configuration_error_t("coalesced events must be specified as an array");
+    }
+
+    for(Json::Value::const_iterator it = events.begin(); it != events.end(); ++it) {
+        m_events.insert((*it).asString());
+    }
+}
+
+bool
+coalescer_t::eligible(const api::event_t& event) const {
+    return m_events.find(event.type) != m_events.end();
+}
+
+std::string
+coalescer_t::key(const api::event_t& event,
+                 const std::vector<std::string>& chunks)
+{
+    EVP_MD_CTX * context = EVP_MD_CTX_create();
+
+    EVP_DigestInit_ex(context, EVP_sha256(), NULL);
+
+    const std::string& type = event.type;
+    uint64_t size = type.size();
+
+    EVP_DigestUpdate(context, &size, sizeof(size));
+    EVP_DigestUpdate(context, type.data(), type.size());
+
+    // NOTE: Chunk boundaries are a part of the request as seen by the slave,
+    // so they're hashed into the key along with the chunks themselves.
+    for(std::vector<std::string>::const_iterator it = chunks.begin();
+        it != chunks.end();
+        ++it)
+    {
+        size = it->size();
+
+        EVP_DigestUpdate(context, &size, sizeof(size));
+        EVP_DigestUpdate(context, it->data(), it->size());
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+
+    EVP_DigestFinal_ex(context, digest, &length);
+    EVP_MD_CTX_destroy(context);
+
+    return std::string(reinterpret_cast<const char*>(digest), length);
+}
+
+boost::shared_ptr<flight_t>
+coalescer_t::join(const std::string& key,
+                  const boost::shared_ptr<api::stream_t>& upstream,
+                  bool& leader)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    flight_map_t::iterator it(m_flights.find(key));
+
+    if(it != m_flights.end() && it->second->subscribe(upstream)) {
+        leader = false;
+        ++m_joined;
+        return it->second;
+    }
+
+    boost::shared_ptr<flight_t> flight(
+        boost::make_shared<flight_t>(
+            shared_from_this(),
+            m_handle,
+            key
+        )
+    );
+
+    flight->subscribe(upstream);
+
+    // NOTE: Replaces the flight which has just landed, if any.
+    m_flights[key] = flight;
+
+    leader = true;
+    ++m_started;
+
+    return flight;
+}
+
+void
+coalescer_t::forget(const std::string& key,
+                    const flight_t * flight)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    flight_map_t::iterator it(m_flights.find(key));
+
+    if(it != m_flights.end() && it->second.get() == flight) {
+        m_flights.erase(it);
+    }
+}
+
+Json::Value
+coalescer_t::info() {
+    Json::Value info(Json::objectValue);
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        info["in-flight"] = static_cast<Json::LargestUInt>(m_flights.size());
+    }
+
+    info["started"] = static_cast<Json::LargestUInt>(m_started.load());
+    info["joined"] = static_cast<Json::LargestUInt>(m_joined.load());
+
+    return info;
+}
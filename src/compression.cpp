@@ -0,0 +1,161 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/compression.hpp"
+#include "cocaine/config.hpp"
+
+#ifdef COCAINE_HAVE_LZ4
+ #include <lz4.h>
+#endif
+
+#include <limits>
+
+#include <time.h>
+
+using namespace cocaine;
+
+namespace {
+    // NOTE: The LZ4 block format can't expand the data more than this, so the
+    // larger original sizes can only be announced by a broken or hostile peer.
+    static const size_t expansion_limit = 255;
+
+    uint64_t
+    cpu_time() {
+        struct timespec now;
+
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+        return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+    }
+}
+
+compressor_t::compressor_t():
+    m_compressed(0),
+    m_skipped(0),
+    m_decompressed(0),
+    m_raw_bytes(0),
+    m_packed_bytes(0),
+    m_compression_time(0),
+    m_decompression_time(0)
+{ }
+
+bool
+compressor_t::available() {
+#ifdef COCAINE_HAVE_LZ4
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool
+compressor_t::compress(const char * data,
+                       size_t size,
+                       std::string& result)
+{
+#ifdef COCAINE_HAVE_LZ4
+    if(size == 0 || size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+        ++m_skipped;
+        return false;
+    }
+
+    const uint64_t started = cpu_time();
+
+    // NOTE: Only the compressed data which is strictly smaller than the original
+    // is worth sending, so the output buffer is limited to that.
+    result.resize(size);
+
+    const int packed = LZ4_compress_default(data, &result[0], size, size - 1);
+
+    m_compression_time += cpu_time() - started;
+
+    if(packed <= 0) {
+        ++m_skipped;
+        return false;
+    }
+
+    result.resize(packed);
+
+    ++m_compressed;
+
+    m_raw_bytes += size;
+    m_packed_bytes += packed;
+
+    return true;
+#else
+    ++m_skipped;
+    return false;
+#endif
+}
+
+void
+compressor_t::decompress(const char * data,
+                         size_t size,
+                         size_t original,
+                         std::string& result)
+{
+#ifdef COCAINE_HAVE_LZ4
+    if(size > static_cast<size_t>(std::numeric_limits<int>::max()) ||
+       original > static_cast<size_t>(std::numeric_limits<int>::max()))
+    {
+        throw cocaine::error_t("the compressed data is too large");
+    }
+
+    // NOTE: The buffer is allocated upfront, so the announced size has to be
+    // checked before it's trusted.
+    if(original > size * expansion_limit) {
+        throw cocaine::error_t("the compressed data is corrupted");
+    }
+
+    const uint64_t started = cpu_time();
+
+    result.resize(original);
+
+    const int unpacked = LZ4_decompress_safe(data, &result[0], size, original);
+
+    m_decompression_time += cpu_time() - started;
+
+    if(unpacked < 0 || static_cast<size_t>(unpacked) != original) {
+        throw cocaine::error_t("the compressed data is corrupted");
+    }
+
+    ++m_decompressed;
+#else
+    throw cocaine::error_t("the compression support is not available");
+#endif
+}
+
+Json::Value
+compressor_t::info() const {
+    Json::Value info(Json::objectValue);
+
+    const uint64_t raw = m_raw_bytes,
+                   packed = m_packed_bytes;
+
+    info["available"] = available();
+    info["compressed"] = static_cast<Json::LargestUInt>(m_compressed);
+    info["skipped"] = static_cast<Json::LargestUInt>(m_skipped);
+    info["decompressed"] = static_cast<Json::LargestUInt>(m_decompressed);
+    info["ratio"] = packed ? static_cast<double>(raw) / packed : 0.0f;
+    info["compression-time"] = static_cast<double>(m_compression_time) / 1000000.0f;
+    info["decompression-time"] = static_cast<double>(m_decompression_time) / 1000000.0f;
+
+    return info;
+}
@@ -22,6 +22,8 @@
 
 #include "cocaine/io.hpp"
 #include "cocaine/logging.hpp"
+#include "cocaine/pool_arbiter.hpp"
+#include "cocaine/pressure.hpp"
 
 #include "cocaine/api/logger.hpp"
 
@@ -46,11 +48,36 @@ const float defaults::heartbeat_timeout = 30.0f;
 const float defaults::idle_timeout = 600.0f;
 const float defaults::startup_timeout = 10.0f;
 const float defaults::termination_timeout = 5.0f;
+const float defaults::drain_timeout = 30.0f;
 const unsigned long defaults::pool_limit = 10L;
 const unsigned long defaults::queue_limit = 100L;
+const unsigned long defaults::pending_limit = 100L;
+const unsigned long defaults::queue_bytes = 0L;
+const unsigned long defaults::queue_memory = 64L * 1024 * 1024;
+const unsigned long defaults::shm_ring = 0L;
+const unsigned long defaults::fd_threshold = 0L;
+const unsigned long defaults::compression_threshold = 0L;
 const unsigned long defaults::concurrency = 10L;
+const unsigned long defaults::batch_size = 16L;
+const unsigned long defaults::session_window = 0L;
+const unsigned long defaults::max_sessions = 0L;
+const unsigned long defaults::max_rss = 0L;
+const float defaults::spawn_rate = 5.0f;
+const float defaults::spawn_backoff = 60.0f;
+const float defaults::weight = 1.0f;
+
+const unsigned long defaults::concurrent_spawns = 16L;
+const unsigned long defaults::symbol_quota = 256L;
+
+// NOTE: The host pressure monitoring is disabled by default, as the sensible
+// thresholds depend on the host workload too much.
+const float defaults::pressure_interval = 0.0f;
+const float defaults::memory_pressure = 10.0f;
+const float defaults::cpu_pressure = 60.0f;
+const float defaults::available_memory = 0.1f;
 
 const long defaults::control_timeout = 500L;
+const float defaults::status_interval = 0.1f;
 const unsigned long defaults::io_bulk_size = 100L;
 
 const char defaults::plugins_path[] = "/usr/lib/cocaine";
@@ -168,6 +195,29 @@ config_t::config_t(const std::string& config_path) {
 
     network.threads = 1;
 
+    // Node limits
+
+    limits.spawns = root["limits"].get(
+        "concurrent-spawns",
+        static_cast<Json::UInt>(defaults::concurrent_spawns)
+    ).asUInt();
+
+    limits.slaves = root["limits"].get("slaves", 0).asUInt();
+    limits.memory = root["limits"].get("memory", 0).asLargestUInt();
+
+    // Host pressure thresholds
+
+    pressure.interval = root["pressure"].get("interval", defaults::pressure_interval).asDouble();
+    pressure.memory = root["pressure"].get("memory", defaults::memory_pressure).asDouble();
+    pressure.cpu = root["pressure"].get("cpu", defaults::cpu_pressure).asDouble();
+    pressure.available = root["pressure"].get("available", defaults::available_memory).asDouble();
+
+    if(pressure.interval < 0.0f || pressure.memory < 0.0f || pressure.cpu < 0.0f ||
+       pressure.available < 0.0f || pressure.available >= 1.0f)
+    {
+        throw configuration_error_t("the host pressure thresholds are invalid");
+    }
+
     // Component configuration
 
     services = parse(root["services"]);
@@ -230,6 +280,32 @@ port_mapper_t::retain(uint16_t port) {
     m_ports.push(port);
 }
 
+// Spawn budget
+
+spawn_budget_t::spawn_budget_t(unsigned long limit):
+    m_limit(limit),
+    m_used(0)
+{ }
+
+bool
+spawn_budget_t::acquire() {
+    unsigned long used = m_used.load();
+
+    do {
+        if(m_limit && used >= m_limit) {
+            return false;
+        }
+    } while(!m_used.compare_exchange_weak(used, used + 1));
+
+    return true;
+}
+
+void
+spawn_budget_t::release() {
+    BOOST_ASSERT(m_used > 0);
+    --m_used;
+}
+
 // Context
 
 context_t::context_t(config_t config_,
@@ -262,6 +338,9 @@ context_t::initialize() {
     // Initialize the I/O subsystems.
     m_io.reset(new zmq::context_t(config.network.threads));
     m_port_mapper.reset(new port_mapper_t(config.network.ports));
+    m_spawn_budget.reset(new spawn_budget_t(config.limits.spawns));
+    m_pool_arbiter.reset(new engine::pool_arbiter_t(config.limits.slaves, config.limits.memory));
+    m_pressure_monitor.reset(new pressure_monitor_t(config));
 
     // Initialize the repository.
     m_repository.reset(new api::repository_t());
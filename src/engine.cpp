@@ -20,13 +20,21 @@
 
 #include "cocaine/engine.hpp"
 
+#include "cocaine/admission.hpp"
+#include "cocaine/coalescing.hpp"
 #include "cocaine/context.hpp"
+#include "cocaine/hedging.hpp"
 #include "cocaine/logging.hpp"
 #include "cocaine/manifest.hpp"
+#include "cocaine/pool_arbiter.hpp"
+#include "cocaine/pressure.hpp"
 #include "cocaine/profile.hpp"
+#include "cocaine/response_cache.hpp"
 #include "cocaine/rpc.hpp"
 #include "cocaine/session.hpp"
+#include "cocaine/slab.hpp"
 #include "cocaine/slave.hpp"
+#include "cocaine/spool.hpp"
 
 #include "cocaine/api/event.hpp"
 #include "cocaine/api/stream.hpp"
@@ -34,11 +42,16 @@
 #include "cocaine/traits/json.hpp"
 #include "cocaine/traits/unique_id.hpp"
 
+#include <cmath>
+
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/median.hpp>
 #include <boost/accumulators/statistics/sum.hpp>
 
 #include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/future.hpp>
 #include <boost/weak_ptr.hpp>
 
 using namespace cocaine;
@@ -46,6 +59,8 @@ using namespace cocaine::engine;
 using namespace cocaine::io;
 using namespace cocaine::logging;
 
+namespace fs = boost::filesystem;
+
 // Session queue
 
 void
@@ -61,8 +76,10 @@ namespace {
     struct downstream_t:
         public api::stream_t
     {
-        downstream_t(const boost::shared_ptr<session_t>& session):
+        downstream_t(const boost::shared_ptr<session_t>& session,
+                     const boost::shared_ptr<handle_t>& handle):
             m_session(session),
+            m_handle(handle),
             m_state(state_t::open)
         { }
        
@@ -139,8 +156,197 @@ namespace {
             }
         }
 
+        virtual
+        void
+        cancel() {
+            m_state = state_t::closed;
+
+            const boost::shared_ptr<session_t> ptr = m_session.lock();
+
+            if(!ptr) {
+                return;
+            }
+
+            boost::shared_lock<boost::shared_mutex> lock(m_handle->mutex);
+
+            if(m_handle->engine) {
+                m_handle->engine->cancel(ptr);
+            }
+        }
+
+        virtual
+        bool
+        writable() {
+            const boost::shared_ptr<session_t> ptr = m_session.lock();
+            return !ptr || ptr->writable();
+        }
+
+        virtual
+        void
+        notify(const boost::function<void()>& callback) {
+            const boost::shared_ptr<session_t> ptr = m_session.lock();
+
+            if(ptr) {
+                ptr->notify(callback);
+            } else {
+                callback();
+            }
+        }
+
     private:
         const boost::weak_ptr<session_t> m_session;
+        const boost::shared_ptr<handle_t> m_handle;
+
+        enum class state_t: int {
+            open,
+            closed
+        };
+
+        state_t m_state;
+    };
+
+    // NOTE: Represents a client's interest in a coalesced session, so that it
+    // could be withdrawn without affecting the other subscribers.
+    struct subscription_t:
+        public api::stream_t
+    {
+        subscription_t(const boost::shared_ptr<flight_t>& flight,
+                       const boost::shared_ptr<api::stream_t>& upstream):
+            m_flight(flight),
+            m_upstream(upstream)
+        { }
+
+        virtual
+        void
+        push(const char * chunk,
+             size_t size)
+        {
+            throw cocaine::error_t("the stream has been closed");
+        }
+
+        virtual
+        void
+        error(error_code code,
+              const std::string& message)
+        {
+            throw cocaine::error_t("the stream has been closed");
+        }
+
+        virtual
+        void
+        close() {
+            throw cocaine::error_t("the stream has been closed");
+        }
+
+        virtual
+        void
+        cancel() {
+            m_flight->unsubscribe(m_upstream);
+        }
+
+    private:
+        const boost::shared_ptr<flight_t> m_flight;
+        const boost::shared_ptr<api::stream_t> m_upstream;
+    };
+
+    // NOTE: Buffers the whole request before handing it over to the engine, so
+    // that identical requests could be coalesced or served from the cache. A
+    // failure to enqueue the request at this point is reported via the upstream.
+    struct deferred_t:
+        public api::stream_t
+    {
+        deferred_t(const api::event_t& event,
+                   const boost::shared_ptr<api::stream_t>& upstream,
+                   const boost::shared_ptr<handle_t>& handle):
+            m_event(event),
+            m_upstream(upstream),
+            m_handle(handle),
+            m_state(state_t::open)
+        { }
+
+        // NOTE: A stream dropped without being closed has been abandoned by the
+        // client, so the incomplete request is simply discarded.
+
+        virtual
+        void
+        push(const char * chunk,
+             size_t size)
+        {
+            switch(m_state) {
+                case state_t::open:
+                    m_chunks.emplace_back(chunk, size);
+                    break;
+
+                case state_t::closed:
+                    throw cocaine::error_t("the stream has been closed");
+            }
+        }
+
+        virtual
+        void
+        error(error_code code,
+              const std::string& message)
+        {
+            switch(m_state) {
+                case state_t::open:
+                    m_state = state_t::closed;
+
+                    // NOTE: The request has been aborted before it was even
+                    // dispatched, so there's simply nothing to do.
+                    m_chunks.clear();
+
+                    break;
+
+                case state_t::closed:
+                    throw cocaine::error_t("the stream has been closed");
+            }
+        }
+
+        virtual
+        void
+        close() {
+            switch(m_state) {
+                case state_t::open: {
+                    m_state = state_t::closed;
+
+                    std::vector<std::string> chunks;
+
+                    chunks.swap(m_chunks);
+
+                    boost::shared_lock<boost::shared_mutex> lock(m_handle->mutex);
+
+                    if(!m_handle->engine) {
+                        m_upstream->error(resource_error, "engine is not active");
+                        break;
+                    }
+
+                    m_subscription = m_handle->engine->replay(m_event, m_upstream, chunks);
+
+                    break;
+                }
+
+                case state_t::closed:
+                    throw cocaine::error_t("the stream has been closed");
+            }
+        }
+
+        virtual
+        void
+        cancel() {
+            m_state = state_t::closed;
+
+            if(m_subscription) {
+                m_subscription->cancel();
+            }
+        }
+
+    private:
+        const api::event_t m_event;
+        const boost::shared_ptr<api::stream_t> m_upstream;
+        const boost::shared_ptr<handle_t> m_handle;
+
+        std::vector<std::string> m_chunks;
+        boost::shared_ptr<api::stream_t> m_subscription;
 
         enum class state_t: int {
             open,
@@ -151,17 +357,33 @@ namespace {
     };
 }
 
+namespace {
+    token_bucket_t*
+    spawn_limiter(const profile_t& profile) {
+        if(profile.spawn_rate == 0.0f) {
+            return NULL;
+        }
+
+        // NOTE: The whole pool is allowed to be spawned at once.
+        return new token_bucket_t(profile.spawn_rate, profile.pool_limit);
+    }
+}
+
 // Engine
 
 engine_t::engine_t(context_t& context,
-                   const manifest_t& manifest,
-                   const profile_t& profile):
+                   const boost::shared_ptr<const manifest_t>& manifest,
+                   const boost::shared_ptr<const profile_t>& profile,
+                   const std::string& path):
     m_context(context),
-    m_log(new log_t(context, cocaine::format("app/%1%", manifest.name))),
+    m_log(new log_t(context, cocaine::format("app/%1%", manifest->name))),
     m_manifest(manifest),
     m_profile(profile),
+    m_generation(0),
+    m_next_generation(1),
+    m_path(path),
     m_state(state_t::stopped),
-    m_bus(new io::shared_channel_t(context, ZMQ_ROUTER, m_manifest.name)),
+    m_bus(new io::shared_channel_t(context, ZMQ_ROUTER, m_manifest->name)),
     m_ctl(new io::unique_channel_t(context, ZMQ_PAIR)),
     m_bus_watcher(m_loop),
     m_ctl_watcher(m_loop),
@@ -169,20 +391,44 @@ engine_t::engine_t(context_t& context,
     m_ctl_checker(m_loop),
     m_gc_timer(m_loop),
     m_termination_timer(m_loop),
+    m_hedge_timer(m_loop),
+    m_drain_timer(m_loop),
     m_notification(m_loop),
-    m_next_id(0)
+    m_snapshot_checker(m_loop),
+    m_snapshot_timer(m_loop),
+    m_published(0.0f),
+    m_dirty(false),
+    m_handle(boost::make_shared<handle_t>(this)),
+    m_next_id(0),
+    m_slab(boost::make_shared<slab_t>()),
+    m_spool(boost::make_shared<spool_t>(
+        cocaine::format("%s/engines", context.config.path.runtime),
+        profile->queue_memory
+    )),
+    m_interned(0),
+    m_drain_started(0.0f),
+    m_drain_total(0),
+    m_spawn_limiter(spawn_limiter(*profile)),
+    m_spawn_failures(0),
+    m_spawn_backoff(0.0f),
+    m_spawn_stats(),
+    m_resident(0),
+    m_admission(new admission_t(profile->admission)),
+    m_hedging(new hedging_t(profile->hedging)),
+    m_coalescer(boost::make_shared<coalescer_t>(m_handle, profile->coalescing)),
+    m_cache(new response_cache_t(profile->caching))
 {
     m_isolate = m_context.get<api::isolate_t>(
-        m_profile.isolate.type,
+        m_profile->isolate.type,
         m_context,
-        m_manifest.name,
-        m_profile.isolate.args
+        m_manifest->name,
+        m_profile->isolate.args
     );
     
     std::string bus_endpoint = cocaine::format(
         "ipc://%1%/engines/%2%",
         m_context.config.path.runtime,
-        m_manifest.name
+        m_manifest->name
     );
 
     try {
@@ -193,7 +439,7 @@ engine_t::engine_t(context_t& context,
    
     std::string ctl_endpoint = cocaine::format(
         "inproc://%s",
-        m_manifest.name
+        m_manifest->name
     );
 
     try {
@@ -215,12 +461,30 @@ engine_t::engine_t(context_t& context,
     m_gc_timer.set<engine_t, &engine_t::on_cleanup>(this);
     m_gc_timer.start(5.0f, 5.0f);
 
+    m_snapshot_checker.set<engine_t, &engine_t::on_snapshot>(this);
+    m_snapshot_checker.start();
+    m_snapshot_timer.set<engine_t, &engine_t::on_snapshot_timeout>(this);
+
     m_notification.set<engine_t, &engine_t::on_notification>(this);
     m_notification.start();
+
+    if(m_hedging->enabled()) {
+        m_hedge_timer.set<engine_t, &engine_t::on_hedge>(this);
+        m_hedge_timer.start(m_hedging->interval(), m_hedging->interval());
+    }
+
+    publish();
 }
 
 engine_t::~engine_t() {
     BOOST_ASSERT(m_state == state_t::stopped);
+
+    {
+        boost::unique_lock<boost::shared_mutex> lock(m_handle->mutex);
+        m_handle->engine = NULL;
+    }
+
+    m_context.pools().remove(m_manifest->name);
 }
 
 void
@@ -229,33 +493,83 @@ engine_t::run() {
     m_loop.loop();
 }
 
+namespace {
+    typedef boost::promise<
+        boost::shared_ptr<api::stream_t>
+    > promise_type;
+
+    void
+    fulfill(const boost::shared_ptr<promise_type>& promise,
+            const boost::shared_ptr<api::stream_t>& downstream)
+    {
+        promise->set_value(downstream);
+    }
+}
+
 boost::shared_ptr<api::stream_t>
 engine_t::enqueue(const api::event_t& event,
                   const boost::shared_ptr<api::stream_t>& upstream,
                   engine::mode mode)
 {
-    boost::shared_ptr<session_t> session = boost::make_shared<session_t>(
-        m_next_id++,
-        event,
-        upstream
-    );
+    if(mode == engine::mode::blocking) {
+        boost::shared_ptr<promise_type> promise(
+            boost::make_shared<promise_type>()
+        );
+
+        boost::unique_future<
+            boost::shared_ptr<api::stream_t>
+        > future(promise->get_future());
+
+        // NOTE: Only the calling thread is blocked here, the engine itself just
+        // fulfills the promise when it admits the session into the queue.
+        enqueue_async(event, upstream, boost::bind(&fulfill, promise, _1));
+
+        const boost::shared_ptr<api::stream_t> downstream(future.get());
+
+        if(!downstream) {
+            throw cocaine::error_t("engine is shutting down");
+        }
+
+        return downstream;
+    }
+
+    // NOTE: Check the rate limits before doing anything else, so that the
+    // rejections would be as cheap as possible.
+    if(!m_admission->admit(event)) {
+        throw cocaine::error_t("the rate limit has been exceeded");
+    }
+
+    // NOTE: Coalesced and cached sessions can only be matched against the
+    // sessions in flight or the cached responses once the whole request is
+    // known, so it's buffered until then.
+    if(m_coalescer->eligible(event) || m_cache->eligible(event)) {
+        return boost::make_shared<deferred_t>(event, upstream, m_handle);
+    }
+
+    boost::shared_ptr<session_t> session = create(event, upstream);
 
+    try {
+        submit(session);
+    } catch(const cocaine::error_t& e) {
+        // NOTE: The request hasn't been served, so the retries shouldn't be rate
+        // limited on its account.
+        m_admission->refund(event);
+        throw;
+    }
+
+    return downstream(session);
+}
+
+void
+engine_t::submit(const boost::shared_ptr<session_t>& session) {
     boost::unique_lock<session_queue_t> lock(m_queue);
 
     if(m_state != state_t::running) {
         throw cocaine::error_t("engine is not active");
     }
 
-    if(m_profile.queue_limit > 0) {
-        if(mode == engine::mode::normal &&
-           m_queue.size() >= m_profile.queue_limit)
-        {
-            throw cocaine::error_t("the queue is full");
-        }
-
-        while(m_queue.size() >= m_profile.queue_limit) {
-            m_condition.wait(lock);
-        }
+    if(saturated()) {
+        throw cocaine::error_t("the queue is full");
     }
 
     m_queue.push(session);
@@ -267,103 +581,868 @@ engine_t::enqueue(const api::event_t& event,
 
     // Pump the queue! 
     m_notification.send();
-
-    return boost::make_shared<downstream_t>(session);
 }
 
-bool
-engine_t::send(const unique_id_t& uuid,
-               int message_id,
-               const std::string& message)
+boost::shared_ptr<api::stream_t>
+engine_t::replay(const api::event_t& event,
+                 const boost::shared_ptr<api::stream_t>& upstream,
+                 const std::vector<std::string>& chunks)
 {
-    boost::unique_lock<io::shared_channel_t> lock(*m_bus);
+    const std::string key(coalescer_t::key(event, chunks));
 
-    return m_bus->send(uuid, ZMQ_SNDMORE) &&
-           m_bus->send_message(message_id, message);    
-}
+    if(m_cache->eligible(event)) {
+        response_cache_t::chunk_list_t response;
 
-void
-engine_t::on_bus_event(ev::io&, int) {
-    bool pending = false;
+        if(m_cache->lookup(key, response)) {
+            for(response_cache_t::chunk_list_t::const_iterator it = response.begin();
+                it != response.end();
+                ++it)
+            {
+                upstream->push(it->data(), it->size());
+            }
 
-    {
-        boost::unique_lock<io::shared_channel_t> lock(*m_bus);
-        pending = m_bus->pending();
-    }
+            upstream->close();
 
-    if(pending) {
-        process_bus_events();
+            return boost::shared_ptr<api::stream_t>();
+        }
     }
-    
-    pump();
-    balance();
-}
 
-void
-engine_t::on_bus_check(ev::prepare&, int) {
-    m_loop.feed_fd_event(m_bus->fd(), ev::READ);
-}
+    boost::shared_ptr<api::stream_t> target(upstream),
+                                     subscription;
 
-void
-engine_t::on_ctl_event(ev::io&, int) {
-    m_ctl_checker.stop();
+    boost::shared_ptr<flight_t> flight;
 
-    if(m_ctl->pending()) {
-        m_ctl_checker.start();
-        process_ctl_events();    
-    }
-}
+    if(m_coalescer->eligible(event)) {
+        bool leader = true;
 
-void
-engine_t::on_ctl_check(ev::prepare&, int) {
-    m_loop.feed_fd_event(m_ctl->fd(), ev::READ);
-}
+        flight = m_coalescer->join(key, upstream, leader);
+        subscription = boost::make_shared<subscription_t>(flight, upstream);
 
-void
-engine_t::on_cleanup(ev::timer&, int) {
-    typedef std::vector<
-        pool_map_t::key_type
-    > corpse_list_t;
-    
-    corpse_list_t corpses;
+        if(!leader) {
+            COCAINE_LOG_DEBUG(m_log, "coalesced a '%s' event with a session in flight", event.type);
 
-    for(pool_map_t::iterator it = m_pool.begin(); it != m_pool.end(); ++it) {
-        if(it->second->state() == slave_t::state_t::dead) {
-            corpses.emplace_back(it->first);
+            // NOTE: The results so far are delivered outside the coalescer lock.
+            flight->catch_up(upstream);
+
+            return subscription;
         }
+
+        target = flight;
     }
 
-    if(!corpses.empty()) {
-        for(corpse_list_t::iterator it = corpses.begin();
-            it != corpses.end();
-            ++it)
-        {
-            m_pool.erase(*it);
-        }
+    if(m_cache->eligible(event)) {
+        target = m_cache->record(key, target);
+    }
 
-        COCAINE_LOG_DEBUG(
-            m_log,
-            "recycled %llu dead %s",
-            corpses.size(),
-            corpses.size() == 1 ? "slave" : "slaves"
-        );
+    boost::shared_ptr<session_t> session = create(event, target);
+
+    try {
+        submit(session);
+    } catch(const cocaine::error_t& e) {
+        // NOTE: The tokens have been taken when the request was enqueued.
+        m_admission->refund(event);
+
+        // NOTE: This also fails every client which has joined the flight so far.
+        target->error(resource_error, e.what());
+        return boost::shared_ptr<api::stream_t>();
     }
-}
 
-void
-engine_t::on_notification(ev::async&, int) {
-    pump();
+    // NOTE: The session is bound once it's in the queue, so that it could be
+    // cancelled if the flight has been abandoned in the meantime.
+    if(flight) {
+        flight->bind(session);
+    }
+
+    boost::shared_ptr<api::stream_t> stream(downstream(session));
+
+    for(std::vector<std::string>::const_iterator it = chunks.begin();
+        it != chunks.end();
+        ++it)
+    {
+        stream->push(it->data(), it->size());
+    }
+
+    stream->close();
+
+    return subscription ? subscription : stream;
 }
 
 void
-engine_t::on_termination(ev::timer&, int) {
+engine_t::enqueue_async(const api::event_t& event,
+                        const boost::shared_ptr<api::stream_t>& upstream,
+                        const callback_type& callback)
+{
+    if(!m_admission->admit(event)) {
+        throw cocaine::error_t("the rate limit has been exceeded");
+    }
+
+    boost::shared_ptr<session_t> session = create(event, upstream);
+
     boost::unique_lock<session_queue_t> lock(m_queue);
+
+    if(m_state != state_t::running) {
+        lock.unlock();
+        m_admission->refund(event);
+        throw cocaine::error_t("engine is not active");
+    }
+
+    // NOTE: If there're other sessions waiting for admission, get in line behind
+    // them even if the queue has some space, so that the admission order is kept.
+    if(saturated() || !m_pending.empty()) {
+        // NOTE: Otherwise, the clients could grow the waiting line without bound,
+        // bypassing the queue limit.
+        if(m_profile->pending_limit > 0 && m_pending.size() >= m_profile->pending_limit) {
+            lock.unlock();
+            m_admission->refund(event);
+            throw cocaine::error_t("the queue is full");
+        }
+
+        m_pending.emplace_back(session, callback);
+        return;
+    }
+
+    m_queue.push(session);
+
+    lock.unlock();
+
+    m_notification.send();
+
+    callback(downstream(session));
+}
+
+std::vector<boost::shared_ptr<api::stream_t>>
+engine_t::enqueue_batch(const batch_type& batch) {
+    std::vector<boost::shared_ptr<api::stream_t>> result(batch.size());
+    std::vector<boost::shared_ptr<session_t>> sessions(batch.size());
+
+    size_t admitted = 0;
+
+    // NOTE: The events rejected by the admission control get an empty
+    // downstream in the result, while the others are admitted as usual.
+    for(size_t i = 0; i < batch.size(); ++i) {
+        if(!m_admission->admit(batch[i].first)) {
+            continue;
+        }
+
+        sessions[i] = create(batch[i].first, batch[i].second);
+
+        ++admitted;
+    }
+
+    if(!admitted) {
+        return result;
+    }
+
+    boost::unique_lock<session_queue_t> lock(m_queue);
+
+    if(m_state != state_t::running || saturated(admitted)) {
+        const bool active = m_state == state_t::running;
+
+        lock.unlock();
+
+        // NOTE: The whole batch is rejected, so the admission tokens taken for
+        // it are returned, otherwise the retries would be rate limited too.
+        for(size_t i = 0; i < sessions.size(); ++i) {
+            if(sessions[i]) {
+                m_admission->refund(batch[i].first);
+            }
+        }
+
+        throw cocaine::error_t(active ? "the queue is full" : "engine is not active");
+    }
+
+    for(size_t i = 0; i < sessions.size(); ++i) {
+        if(sessions[i]) {
+            m_queue.push(sessions[i]);
+        }
+    }
+
+    lock.unlock();
+
+    // Pump the queue once for the whole batch.
+    m_notification.send();
+
+    for(size_t i = 0; i < sessions.size(); ++i) {
+        if(sessions[i]) {
+            result[i] = downstream(sessions[i]);
+        }
+    }
+
+    return result;
+}
+
+boost::shared_ptr<session_t>
+engine_t::create(const api::event_t& event,
+                 const boost::shared_ptr<api::stream_t>& upstream)
+{
+    // NOTE: This is called from the driver threads, while the profile might be
+    // replaced by the engine thread at any moment.
+    const unsigned long window = boost::atomic_load(&m_profile)->session_window;
+
+    if(!m_hedging->eligible(event)) {
+        return boost::allocate_shared<session_t>(
+            slab_allocator<session_t>(m_slab),
+            m_next_id++,
+            event,
+            upstream,
+            window,
+            m_spool
+        );
+    }
+
+    // NOTE: Hedged sessions deliver their results through the arbiter, so
+    // that a duplicate could be started later on without the client noticing.
+    boost::shared_ptr<arbiter_t> arbiter(
+        boost::make_shared<arbiter_t>(boost::ref(*this), upstream)
+    );
+
+    boost::shared_ptr<session_t> session(
+        boost::allocate_shared<session_t>(
+            slab_allocator<session_t>(m_slab),
+            m_next_id++,
+            event,
+            arbiter->lane(),
+            window,
+            m_spool
+        )
+    );
+
+    arbiter->bind(session);
+
+    return session;
+}
+
+boost::shared_ptr<api::stream_t>
+engine_t::downstream(const boost::shared_ptr<session_t>& session) {
+    return boost::allocate_shared<downstream_t>(
+        slab_allocator<downstream_t>(m_slab),
+        session,
+        m_handle
+    );
+}
+
+void
+engine_t::cancel(const boost::shared_ptr<session_t>& session) {
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+        m_cancelled.push_back(session);
+    }
+
+    m_notification.send();
+}
+
+namespace {
+    // NOTE: Invoked by the session upstream once it has drained, from any thread.
+    // The session is only weakly referenced, as the upstream is owned by it.
+    struct resumption_t {
+        void
+        operator()() const {
+            const boost::shared_ptr<session_t> ptr = session.lock();
+
+            if(!ptr) {
+                return;
+            }
+
+            boost::shared_lock<boost::shared_mutex> lock(handle->mutex);
+
+            if(handle->engine) {
+                handle->engine->resume(ptr);
+            }
+        }
+
+        boost::weak_ptr<session_t> session;
+        boost::shared_ptr<handle_t> handle;
+    };
+}
+
+symbol_t
+engine_t::intern(const std::string& name) {
+    symbol_t symbol(name);
+
+    // NOTE: The names which are already in the table don't cost anything.
+    if(symbol.interned() || m_interned >= defaults::symbol_quota) {
+        return symbol;
+    }
+
+    symbol = symbol_t::intern(name);
+
+    if(symbol.interned()) {
+        ++m_interned;
+    }
+
+    return symbol;
+}
+
+void
+engine_t::withhold(const boost::shared_ptr<session_t>& session,
+                   uint64_t credits)
+{
+    if(!session->withhold(credits)) {
+        // The upstream is already being watched.
+        return;
+    }
+
+    const resumption_t resumption = { session, m_handle };
+
+    session->upstream->notify(resumption);
+}
+
+void
+engine_t::resume(const boost::shared_ptr<session_t>& session) {
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+        m_resumed.push_back(session);
+    }
+
+    m_notification.send();
+}
+
+namespace {
+    // NOTE: Removes the directory an app version has been deployed to. The
+    // failures are not fatal, the directory is just left behind.
+    void
+    discard(const std::string& path) {
+        if(path.empty()) {
+            return;
+        }
+
+        boost::system::error_code code;
+
+        fs::remove_all(path, code);
+    }
+}
+
+void
+engine_t::upgrade(const boost::shared_ptr<const manifest_t>& manifest,
+                  const boost::shared_ptr<const profile_t>& profile,
+                  const std::string& path)
+{
+    std::unique_ptr<upgrade_t> upgrade(new upgrade_t());
+
+    upgrade->manifest = manifest;
+    upgrade->profile = profile;
+    upgrade->path = path;
+
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+
+        if(m_state != state_t::running) {
+            throw cocaine::error_t("engine is not active");
+        }
+
+        // NOTE: If there's an upgrade request which hasn't been picked up yet,
+        // it's superseded by this one.
+        std::swap(m_requested_upgrade, upgrade);
+    }
+
+    if(upgrade) {
+        discard(upgrade->path);
+    }
+
+    m_notification.send();
+}
+
+boost::shared_ptr<const manifest_t>
+engine_t::manifest() const {
+    return boost::atomic_load(&m_manifest);
+}
+
+boost::shared_ptr<const profile_t>
+engine_t::profile() const {
+    return boost::atomic_load(&m_profile);
+}
+
+bool
+engine_t::send(const unique_id_t& uuid,
+               int message_id,
+               const std::string& message)
+{
+    boost::unique_lock<io::shared_channel_t> lock(*m_bus);
+
+    return m_bus->send(uuid, ZMQ_SNDMORE) &&
+           m_bus->send_message(message_id, message);    
+}
+
+void
+engine_t::on_bus_event(ev::io&, int) {
+    bool pending = false;
+
+    {
+        boost::unique_lock<io::shared_channel_t> lock(*m_bus);
+        pending = m_bus->pending();
+    }
+
+    // NOTE: This handler is invoked on every loop iteration, see on_bus_check(),
+    // so it only marks the state as changed if there were any messages.
+    if(pending) {
+        process_bus_events();
+        m_dirty = true;
+    }
+
+    if(m_upgrade) {
+        complete_upgrade();
+    }
+    
+    pump();
+    balance();
+
+    if(m_state == state_t::draining && m_queue.empty()) {
+        COCAINE_LOG_INFO(m_log, "the queue has been drained");
+        migrate(state_t::stopping);
+    }
+}
+
+void
+engine_t::on_bus_check(ev::prepare&, int) {
+    m_loop.feed_fd_event(m_bus->fd(), ev::READ);
+}
+
+void
+engine_t::on_ctl_event(ev::io&, int) {
+    m_ctl_checker.stop();
+
+    if(m_ctl->pending()) {
+        m_ctl_checker.start();
+        process_ctl_events();    
+        m_dirty = true;
+    }
+}
+
+void
+engine_t::on_ctl_check(ev::prepare&, int) {
+    m_loop.feed_fd_event(m_ctl->fd(), ev::READ);
+}
+
+namespace {
+    struct retiring_t {
+        template<class T>
+        bool
+        operator()(const T& slave) const {
+            return slave.second->state() == slave_t::state_t::active &&
+                   slave.second->retiring();
+        }
+    };
+
+    struct busy_t {
+        template<class T>
+        bool
+        operator()(const T& slave) const {
+            return slave.second->state() == slave_t::state_t::active &&
+                   slave.second->load();
+        }
+    };
+
+    struct idle_t {
+        template<class T>
+        bool
+        operator()(const T& slave) const {
+            return slave.second->state() == slave_t::state_t::active &&
+                   !slave.second->retiring() &&
+                   !slave.second->load();
+        }
+    };
+}
+
+void
+engine_t::on_cleanup(ev::timer&, int) {
+    typedef std::vector<
+        pool_map_t::key_type
+    > corpse_list_t;
     
+    corpse_list_t corpses,
+                  bloated,
+                  stale;
+
+    if(m_upgrade) {
+        complete_upgrade();
+        m_dirty = true;
+    }
+
+    for(pool_map_t::iterator it = m_pool.begin(); it != m_pool.end(); ++it) {
+        if(it->second->state() == slave_t::state_t::dead) {
+            corpses.emplace_back(it->first);
+        } else if(it->second->state() == slave_t::state_t::active &&
+                  !it->second->retiring() &&
+                  it->second->generation() != m_generation &&
+                  !(m_upgrade && it->second->generation() == m_upgrade->generation))
+        {
+            // NOTE: These are the slaves of the superseded or abandoned versions
+            // which have activated after the switch.
+            stale.emplace_back(it->first);
+        } else if(m_profile->max_rss &&
+                  it->second->state() == slave_t::state_t::active &&
+                  !it->second->retiring() &&
+                  it->second->resident() > m_profile->max_rss)
+        {
+            bloated.emplace_back(it->first);
+        }
+    }
+
+    // NOTE: Retiring spawns the replacements, so it can't be done while
+    // iterating over the pool.
+    for(corpse_list_t::iterator it = bloated.begin();
+        it != bloated.end();
+        ++it)
+    {
+        retire(*it, "resident set size limit exceeded");
+    }
+
+    for(corpse_list_t::iterator it = stale.begin();
+        it != stale.end();
+        ++it)
+    {
+        retire(*it, "the app version has been superseded", false);
+    }
+
+    if(!corpses.empty() || !bloated.empty() || !stale.empty()) {
+        m_dirty = true;
+    }
+
+    if(!corpses.empty()) {
+        size_t failed = 0;
+
+        for(corpse_list_t::iterator it = corpses.begin();
+            it != corpses.end();
+            ++it)
+        {
+            pool_map_t::iterator slave(m_pool.find(*it));
+
+            if(slave->second->failed()) {
+                ++failed;
+            }
+
+            m_pool.erase(slave);
+        }
+
+        // NOTE: The slaves which have failed within the same cleanup interval
+        // most likely share the reason, so they count as a single failure.
+        if(failed) {
+            m_spawn_stats.failed += failed;
+            backoff();
+        }
+
+        COCAINE_LOG_DEBUG(
+            m_log,
+            "recycled %llu dead %s",
+            corpses.size(),
+            corpses.size() == 1 ? "slave" : "slaves"
+        );
+    }
+
+    if(!m_context.pools().enabled()) {
+        return;
+    }
+
+    m_resident = 0;
+
+    for(pool_map_t::iterator it = m_pool.begin(); it != m_pool.end(); ++it) {
+        m_resident += it->second->resident();
+    }
+
+    const size_t share = report(),
+                 live = m_pool.size() - std::count_if(m_pool.begin(), m_pool.end(), retiring_t());
+
+    if(live <= share) {
+        return;
+    }
+
+    // NOTE: Some other app needs the slaves, so the idle ones are given back to
+    // the node. The busy ones are left alone, the app will shrink as they idle.
+    corpse_list_t idle;
+
+    for(pool_map_t::iterator it = m_pool.begin();
+        it != m_pool.end() && idle.size() != live - share;
+        ++it)
+    {
+        if(idle_t()(*it)) {
+            idle.emplace_back(it->first);
+        }
+    }
+
+    for(corpse_list_t::iterator it = idle.begin();
+        it != idle.end();
+        ++it)
+    {
+        retire(*it, "the slave has been reclaimed by the node", false);
+    }
+}
+
+void
+engine_t::on_notification(ev::async&, int) {
+    m_dirty = true;
+
+    process_cancellations();
+    process_resumptions();
+    process_upgrades();
+    pump();
+
+    if(m_state == state_t::draining && m_queue.empty()) {
+        COCAINE_LOG_INFO(m_log, "the queue has been drained");
+        migrate(state_t::stopping);
+    }
+}
+
+void
+engine_t::on_drain_timeout(ev::timer&, int) {
+    COCAINE_LOG_WARNING(
+        m_log,
+        "unable to drain the queue in %.02f seconds",
+        m_profile->drain_timeout
+    );
+
+    migrate(state_t::stopping);
+}
+
+void
+engine_t::on_termination(ev::timer&, int) {
+    // NOTE: The queue must not be locked here, as stop() locks it on its own to
+    // take the requested upgrade.
     COCAINE_LOG_WARNING(m_log, "forcing the engine termination");
     
     stop();
 }
 
+namespace {
+    // NOTE: Packs the invocation message for the slave, by the handler index
+    // if the slave has announced one for the event, or by the event name.
+    std::pair<int, std::string>
+    invocation(const slave_t& slave,
+               uint64_t tag,
+               const api::event_t& event)
+    {
+        msgpack::sbuffer buffer;
+        uint32_t handler;
+
+        if(slave.handler(event.type, handler)) {
+            type_traits<event_traits<rpc::invoke_id>::tuple_type>::pack(
+                buffer,
+                tag,
+                handler
+            );
+
+            return std::make_pair(
+                event_traits<rpc::invoke_id>::id,
+                std::string(buffer.data(), buffer.size())
+            );
+        }
+
+        type_traits<event_traits<rpc::invoke>::tuple_type>::pack(
+            buffer,
+            tag,
+            event.type.str()
+        );
+
+        return std::make_pair(
+            event_traits<rpc::invoke>::id,
+            std::string(buffer.data(), buffer.size())
+        );
+    }
+}
+
+void
+engine_t::on_hedge(ev::timer&, int) {
+    std::vector<hedging_t::entry_t*> due;
+
+    m_hedging->scan(m_loop.now(), due);
+
+    for(std::vector<hedging_t::entry_t*>::iterator it = due.begin();
+        it != due.end();
+        ++it)
+    {
+        hedging_t::entry_t& entry = **it;
+
+        // NOTE: The duplicate must go to a different slave, and it shouldn't
+        // steal the capacity from the sessions waiting in the queue.
+        pool_map_t::iterator slave = m_pool.begin();
+
+        while(slave != m_pool.end() &&
+              (slave->first == entry.slave ||
+               slave->second->state() != slave_t::state_t::active ||
+               slave->second->generation() != m_generation ||
+               slave->second->retiring() ||
+               slave->second->load() >= m_profile->concurrency))
+        {
+            ++slave;
+        }
+
+        if(slave == m_pool.end() || !m_queue.empty()) {
+            break;
+        }
+
+        if(!m_hedging->acquire()) {
+            break;
+        }
+
+        boost::shared_ptr<session_t> session(
+            boost::allocate_shared<session_t>(
+                slab_allocator<session_t>(m_slab),
+                m_next_id++,
+                entry.event,
+                entry.arbiter->lane(),
+                m_profile->session_window
+            )
+        );
+
+        entry.arbiter->bind(session);
+        entry.hedged = true;
+
+        const uint64_t tag = slave->second->acquire();
+        const hedging_t::frame_list_t frames(hedging_t::replay(entry, tag));
+
+        const std::pair<int, std::string> invoke(
+            invocation(*slave->second, tag, session->event)
+        );
+
+        bool success = send(slave->first, invoke.first, invoke.second);
+
+        for(hedging_t::frame_list_t::const_iterator frame = frames.begin();
+            success && frame != frames.end();
+            ++frame)
+        {
+            success = send(slave->first, frame->first, frame->second);
+        }
+
+        if(!success) {
+            COCAINE_LOG_ERROR(m_log, "slave %s has unexpectedly died", slave->first);
+            slave->second->discard(tag);
+            slave->second->abort(resource_error, "the slave has unexpectedly died");
+            m_pool.erase(slave);
+            continue;
+        }
+
+        COCAINE_LOG_DEBUG(
+            m_log,
+            "hedging a '%s' event with session %s on slave %s",
+            entry.event.type,
+            session->id,
+            slave->first
+        );
+
+        slave->second->assign(std::move(session), tag, false);
+    }
+}
+
+namespace {
+    typedef std::vector<
+        std::pair<int, std::string>
+    > frame_list_t;
+
+    template<class Event, typename... Args>
+    void
+    unpack(const std::string& message,
+           Args&... args)
+    {
+        msgpack::unpacked unpacked;
+
+        try {
+            msgpack::unpack(&unpacked, message.data(), message.size());
+        } catch(const msgpack::unpack_error& e) {
+            throw cocaine::error_t("corrupted message");
+        }
+
+        try {
+            type_traits<typename event_traits<Event>::tuple_type>::unpack(
+                unpacked.get(),
+                args...
+            );
+        } catch(const msgpack::type_error& e) {
+            throw cocaine::error_t("message type mismatch");
+        } catch(const std::bad_cast& e) {
+            throw cocaine::error_t("message type mismatch");
+        }
+    }
+
+    // Dispatches a single message unpacked from a reply batch.
+    void
+    demux(slave_t& slave,
+          int message_id,
+          const std::string& message)
+    {
+        switch(message_id) {
+            case event_traits<rpc::chunk>::id: {
+                uint64_t session_id;
+                std::string chunk;
+
+                unpack<rpc::chunk>(message, session_id, chunk);
+
+                slave.on_chunk(session_id, chunk.data(), chunk.size());
+
+                break;
+            }
+
+            case event_traits<rpc::chunk_ref>::id: {
+                uint64_t session_id;
+                uint64_t size;
+
+                unpack<rpc::chunk_ref>(message, session_id, size);
+
+                slave.on_chunk_ref(session_id, size);
+
+                break;
+            }
+
+            case event_traits<rpc::chunk_lz4>::id: {
+                uint64_t session_id;
+                uint64_t original;
+                std::string chunk;
+
+                unpack<rpc::chunk_lz4>(message, session_id, original, chunk);
+
+                slave.on_chunk_lz4(session_id, original, chunk);
+
+                break;
+            }
+
+            case event_traits<rpc::chunk_fd>::id: {
+                uint64_t session_id;
+                uint64_t size;
+
+                unpack<rpc::chunk_fd>(message, session_id, size);
+
+                slave.on_chunk_fd(session_id, size);
+
+                break;
+            }
+
+            case event_traits<rpc::error>::id: {
+                uint64_t session_id;
+                int code;
+                std::string reason;
+
+                unpack<rpc::error>(message, session_id, code, reason);
+
+                slave.on_error(session_id, static_cast<error_code>(code), reason);
+
+                break;
+            }
+
+            case event_traits<rpc::choke>::id: {
+                uint64_t session_id;
+
+                unpack<rpc::choke>(message, session_id);
+
+                slave.on_choke(session_id);
+
+                break;
+            }
+
+            case event_traits<rpc::credit>::id: {
+                uint64_t session_id;
+                uint64_t credits;
+
+                unpack<rpc::credit>(message, session_id, credits);
+
+                slave.on_credit(session_id, credits);
+
+                break;
+            }
+
+            default:
+                throw cocaine::error_t("unexpected message type");
+        }
+    }
+}
+
 void
 engine_t::process_bus_events() {
     // NOTE: Try to read RPC calls in bulk, where the maximum size
@@ -414,12 +1493,19 @@ engine_t::process_bus_events() {
         );
 
         switch(message_id) {
-            case event_traits<rpc::heartbeat>::id:
+            case event_traits<rpc::heartbeat>::id: {
                 lock.unlock();
 
+                const bool activating = slave->second->state() == slave_t::state_t::unknown;
+
                 slave->second->on_ping();
 
+                if(activating) {
+                    m_spawn_failures = 0;
+                }
+
                 break;
+            }
 
             case event_traits<rpc::suicide>::id: {
                 int code;
@@ -436,32 +1522,161 @@ engine_t::process_bus_events() {
                     message
                 );
 
-                m_pool.erase(slave);
+                m_pool.erase(slave);
+
+                if(code == rpc::suicide::abnormal) {
+                    COCAINE_LOG_ERROR(m_log, "the app seems to be broken - stopping");
+                    migrate(state_t::broken);
+                    return;
+                }
+
+                if(m_state != state_t::running &&
+                   m_state != state_t::draining &&
+                   m_pool.empty())
+                {
+                    // If it was the last slave, shut the engine down.
+                    stop();
+                    return;
+                }
+
+                break;
+            }
+
+            case event_traits<rpc::handshake>::id: {
+                std::vector<std::string> features;
+
+                m_bus->recv<rpc::handshake>(features);
+
+                lock.unlock();
+
+                slave->second->on_handshake(features);
+
+                break;
+            }
+
+            case event_traits<rpc::handlers>::id: {
+                std::vector<std::string> events;
+
+                m_bus->recv<rpc::handlers>(events);
+
+                lock.unlock();
+
+                slave->second->on_handlers(events);
+
+                break;
+            }
+
+            case event_traits<rpc::reply_batch>::id: {
+                frame_list_t frames;
+
+                m_bus->recv<rpc::reply_batch>(frames);
+
+                lock.unlock();
+
+                for(frame_list_t::const_iterator it = frames.begin();
+                    it != frames.end();
+                    ++it)
+                {
+                    try {
+                        demux(*slave->second, it->first, it->second);
+                    } catch(const cocaine::error_t& e) {
+                        // NOTE: Same as for the standalone messages below, the
+                        // out-of-band chunks can't be skipped without losing the
+                        // sync with the slave.
+                        if(it->first == event_traits<rpc::chunk_ref>::id ||
+                           it->first == event_traits<rpc::chunk_lz4>::id ||
+                           it->first == event_traits<rpc::chunk_fd>::id)
+                        {
+                            COCAINE_LOG_ERROR(m_log, "slave %s has unexpectedly died - %s", slave_id, e.what());
+                            slave->second->abort(resource_error, "the slave has unexpectedly died");
+                            m_pool.erase(slave);
+                            break;
+                        }
+
+                        COCAINE_LOG_WARNING(
+                            m_log,
+                            "dropping a batched type %d message from slave %s - %s",
+                            it->first,
+                            slave_id,
+                            e.what()
+                        );
+                    }
+                }
+
+                break;
+            }
+
+            case event_traits<rpc::chunk>::id: {
+                uint64_t session_id;
+                std::string message;
+                
+                m_bus->recv<rpc::chunk>(session_id, message);
+
+                lock.unlock();
+
+                slave->second->on_chunk(session_id, message.data(), message.size());
+
+                break;
+            }
+
+            case event_traits<rpc::chunk_ref>::id: {
+                uint64_t session_id;
+                uint64_t size;
+
+                m_bus->recv<rpc::chunk_ref>(session_id, size);
+
+                lock.unlock();
+
+                try {
+                    slave->second->on_chunk_ref(session_id, size);
+                } catch(const cocaine::error_t& e) {
+                    // NOTE: There's no way to resynchronize the ring, as the
+                    // chunk boundaries are only known from the announcements.
+                    COCAINE_LOG_ERROR(m_log, "slave %s has unexpectedly died - %s", slave_id, e.what());
+                    slave->second->abort(resource_error, "the slave has unexpectedly died");
+                    m_pool.erase(slave);
+                }
+
+                break;
+            }
+
+            case event_traits<rpc::chunk_lz4>::id: {
+                uint64_t session_id;
+                uint64_t original;
+                std::string message;
 
-                if(code == rpc::suicide::abnormal) {
-                    COCAINE_LOG_ERROR(m_log, "the app seems to be broken - stopping");
-                    migrate(state_t::broken);
-                    return;
-                }
+                m_bus->recv<rpc::chunk_lz4>(session_id, original, message);
 
-                if(m_state != state_t::running && m_pool.empty()) {
-                    // If it was the last slave, shut the engine down.
-                    stop();
-                    return;
+                lock.unlock();
+
+                try {
+                    slave->second->on_chunk_lz4(session_id, original, message);
+                } catch(const cocaine::error_t& e) {
+                    COCAINE_LOG_ERROR(m_log, "slave %s has unexpectedly died - %s", slave_id, e.what());
+                    slave->second->abort(resource_error, "the slave has unexpectedly died");
+                    m_pool.erase(slave);
                 }
 
                 break;
             }
 
-            case event_traits<rpc::chunk>::id: {
+            case event_traits<rpc::chunk_fd>::id: {
                 uint64_t session_id;
-                std::string message;
-                
-                m_bus->recv<rpc::chunk>(session_id, message);
+                uint64_t size;
+
+                m_bus->recv<rpc::chunk_fd>(session_id, size);
 
                 lock.unlock();
 
-                slave->second->on_chunk(session_id, message);
+                try {
+                    slave->second->on_chunk_fd(session_id, size);
+                } catch(const cocaine::error_t& e) {
+                    // NOTE: Same as above, the descriptors are only matched with
+                    // their announcements by the order.
+                    COCAINE_LOG_ERROR(m_log, "slave %s has unexpectedly died - %s", slave_id, e.what());
+                    slave->second->abort(resource_error, "the slave has unexpectedly died");
+                    m_pool.erase(slave);
+                }
 
                 break;
             }
@@ -496,6 +1711,19 @@ engine_t::process_bus_events() {
                 break;
             }
 
+            case event_traits<rpc::credit>::id: {
+                uint64_t session_id;
+                uint64_t credits;
+
+                m_bus->recv<rpc::credit>(session_id, credits);
+
+                lock.unlock();
+
+                slave->second->on_credit(session_id, credits);
+
+                break;
+            }
+
             default:
                 COCAINE_LOG_WARNING(
                     m_log,
@@ -509,11 +1737,367 @@ engine_t::process_bus_events() {
     } while(--counter);
 }
 
+void
+engine_t::process_cancellations() {
+    std::vector<boost::shared_ptr<session_t>> cancelled;
+    pending_queue_t admitted;
+
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+
+        if(m_cancelled.empty()) {
+            return;
+        }
+
+        cancelled.swap(m_cancelled);
+
+        for(std::vector<boost::shared_ptr<session_t>>::iterator it = cancelled.begin();
+            it != cancelled.end();
+            ++it)
+        {
+            session_queue_t::iterator queued(std::find(m_queue.begin(), m_queue.end(), *it));
+
+            if(queued != m_queue.end()) {
+                m_queue.erase(queued);
+                it->reset();
+            }
+        }
+
+        // NOTE: The sessions dropped from the queue have freed some space for the
+        // ones waiting for admission.
+        if(!m_pending.empty()) {
+            promote(admitted);
+        }
+    }
+
+    for(pending_queue_t::const_iterator it = admitted.begin();
+        it != admitted.end();
+        ++it)
+    {
+        it->second(downstream(it->first));
+    }
+
+    for(std::vector<boost::shared_ptr<session_t>>::const_iterator it = cancelled.begin();
+        it != cancelled.end();
+        ++it)
+    {
+        if(!*it) {
+            COCAINE_LOG_DEBUG(m_log, "dropped a cancelled session from the queue");
+            continue;
+        }
+
+        for(pool_map_t::iterator slave = m_pool.begin(); slave != m_pool.end(); ++slave) {
+            if(slave->second->state() == slave_t::state_t::active &&
+               slave->second->cancel(*it))
+            {
+                break;
+            }
+        }
+    }
+}
+
+void
+engine_t::process_resumptions() {
+    std::vector<boost::shared_ptr<session_t>> resumed;
+
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+        resumed.swap(m_resumed);
+    }
+
+    for(std::vector<boost::shared_ptr<session_t>>::const_iterator it = resumed.begin();
+        it != resumed.end();
+        ++it)
+    {
+        for(pool_map_t::iterator slave = m_pool.begin(); slave != m_pool.end(); ++slave) {
+            if(slave->second->state() == slave_t::state_t::active &&
+               slave->second->resume(*it))
+            {
+                break;
+            }
+        }
+    }
+}
+
+namespace {
+    struct load_t {
+        template<class T>
+        bool
+        operator()(const T& lhs, const T& rhs) const {
+            return lhs.second->load() < rhs.second->load();
+        }
+    };
+
+    struct ready_t {
+        ready_t(unsigned int generation_):
+            generation(generation_)
+        { }
+
+        template<class T>
+        bool
+        operator()(const T& slave) const {
+            return slave.second->state() == slave_t::state_t::active &&
+                   slave.second->generation() == generation &&
+                   !slave.second->retiring();
+        }
+
+        const unsigned int generation;
+    };
+}
+
+void
+engine_t::process_upgrades() {
+    std::unique_ptr<upgrade_t> upgrade;
+
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+        upgrade = std::move(m_requested_upgrade);
+    }
+
+    if(!upgrade || m_state != state_t::running) {
+        return;
+    }
+
+    if(upgrade->manifest == m_manifest &&
+       upgrade->profile->isolate.type == m_profile->isolate.type &&
+       upgrade->profile->isolate.args == m_profile->isolate.args)
+    {
+        reconfigure(upgrade->profile);
+        return;
+    }
+
+    if(m_upgrade) {
+        // NOTE: The slaves which have already been spawned for the abandoned
+        // version are retired by the cleanup timer as they activate.
+        COCAINE_LOG_WARNING(
+            m_log,
+            "abandoning the upgrade to generation %d",
+            m_upgrade->generation
+        );
+
+        discard(m_upgrade->path);
+
+        m_upgrade.reset();
+    }
+
+    try {
+        upgrade->isolate = m_context.get<api::isolate_t>(
+            upgrade->profile->isolate.type,
+            m_context,
+            upgrade->manifest->name,
+            upgrade->profile->isolate.args
+        );
+    } catch(const cocaine::error_t& e) {
+        COCAINE_LOG_ERROR(m_log, "unable to upgrade the app - %s", e.what());
+        discard(upgrade->path);
+        return;
+    }
+
+    // NOTE: The new version is warmed up to the current number of active slaves,
+    // so that the switch doesn't cause a capacity dip. Until then, the pool might
+    // exceed its limit.
+    const size_t active = std::count_if(
+        m_pool.begin(),
+        m_pool.end(),
+        ready_t(m_generation)
+    );
+
+    upgrade->generation = m_next_generation++;
+    upgrade->started = m_loop.now();
+    upgrade->target = std::min(upgrade->profile->pool_limit, std::max(1UL, active));
+
+    COCAINE_LOG_INFO(
+        m_log,
+        "upgrading to generation %d, warming up %llu %s",
+        upgrade->generation,
+        upgrade->target,
+        upgrade->target == 1 ? "slave" : "slaves"
+    );
+
+    // NOTE: A profile reload keeps the current app version directory.
+    const std::string path = upgrade->path.empty() ? m_path : upgrade->path;
+
+    size_t spawned = 0;
+
+    while(spawned != upgrade->target &&
+          spawn(upgrade->generation, upgrade->manifest, upgrade->profile, path))
+    {
+        ++spawned;
+    }
+
+    if(!spawned) {
+        COCAINE_LOG_ERROR(m_log, "unable to upgrade the app - no slaves could be spawned");
+        discard(upgrade->path);
+        return;
+    }
+
+    upgrade->target = spawned;
+    m_upgrade = std::move(upgrade);
+}
+
+void
+engine_t::reconfigure(const boost::shared_ptr<const profile_t>& profile) {
+    COCAINE_LOG_INFO(m_log, "applying the '%s' profile", profile->name);
+
+    pending_queue_t admitted;
+
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+
+        boost::atomic_store(&m_profile, profile);
+
+        m_spool->resize(profile->queue_memory);
+
+        // NOTE: The queue limit might have been raised.
+        promote(admitted);
+    }
+
+    m_spawn_limiter.reset(spawn_limiter(*profile));
+
+    for(pending_queue_t::const_iterator it = admitted.begin();
+        it != admitted.end();
+        ++it)
+    {
+        it->second(downstream(it->first));
+    }
+
+    std::vector<
+        std::pair<unique_id_t, boost::shared_ptr<slave_t>>
+    > current;
+
+    for(pool_map_t::iterator it = m_pool.begin(); it != m_pool.end(); ++it) {
+        if(it->second->state() == slave_t::state_t::dead ||
+           it->second->generation() != m_generation)
+        {
+            continue;
+        }
+
+        it->second->reconfigure(profile);
+
+        if(ready_t(m_generation)(*it)) {
+            current.push_back(*it);
+        }
+    }
+
+    // NOTE: If the pool limit has been lowered, the least loaded slaves are
+    // retired first, so that the fewest sessions have to be waited for.
+    if(current.size() > m_profile->pool_limit) {
+        std::sort(current.begin(), current.end(), load_t());
+
+        for(size_t i = 0; i < current.size() - m_profile->pool_limit; ++i) {
+            retire(current[i].first, "the pool limit has been lowered", false);
+        }
+    }
+
+    pump();
+    balance();
+}
+
+void
+engine_t::complete_upgrade() {
+    const size_t ready = std::count_if(
+        m_pool.begin(),
+        m_pool.end(),
+        ready_t(m_upgrade->generation)
+    );
+
+    const bool expired = m_loop.now() - m_upgrade->started >= m_upgrade->profile->startup_timeout;
+
+    if(ready < m_upgrade->target && !expired) {
+        return;
+    }
+
+    if(!ready) {
+        COCAINE_LOG_ERROR(
+            m_log,
+            "no generation %d slaves have activated in %.02f seconds, rolling back",
+            m_upgrade->generation,
+            m_upgrade->profile->startup_timeout
+        );
+
+        discard(m_upgrade->path);
+
+        m_upgrade.reset();
+
+        return;
+    }
+
+    COCAINE_LOG_INFO(
+        m_log,
+        "switching to generation %d with %llu active %s",
+        m_upgrade->generation,
+        ready,
+        ready == 1 ? "slave" : "slaves"
+    );
+
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+
+        boost::atomic_store(&m_manifest, m_upgrade->manifest);
+        boost::atomic_store(&m_profile, m_upgrade->profile);
+
+        m_spool->resize(m_upgrade->profile->queue_memory);
+    }
+
+    m_generation = m_upgrade->generation;
+    m_isolate = m_upgrade->isolate;
+
+    if(!m_upgrade->path.empty()) {
+        activate(m_upgrade->path);
+    }
+
+    m_upgrade.reset();
+
+    // NOTE: From now on, the sessions are dispatched to the new slaves only, while
+    // the old ones finish the sessions they already have and then deactivate.
+    std::vector<pool_map_t::key_type> superseded;
+
+    for(pool_map_t::iterator it = m_pool.begin(); it != m_pool.end(); ++it) {
+        if(it->second->state() == slave_t::state_t::active &&
+           it->second->generation() != m_generation)
+        {
+            superseded.emplace_back(it->first);
+        }
+    }
+
+    for(std::vector<pool_map_t::key_type>::const_iterator it = superseded.begin();
+        it != superseded.end();
+        ++it)
+    {
+        retire(*it, "the app version has been superseded", false);
+    }
+}
+
+void
+engine_t::activate(const std::string& path) {
+    // NOTE: The app directory is a symlink to the current version, so that the
+    // app would start with it next time. The switch is atomic, as the symlink
+    // is replaced by renaming a new one over it.
+    const fs::path link = fs::path(m_context.config.path.spool) / m_manifest->name,
+                   temporary = fs::path(link.string() + ".switch");
+
+    try {
+        fs::remove(temporary);
+        fs::create_symlink(path, temporary);
+        fs::rename(temporary, link);
+    } catch(const fs::filesystem_error& e) {
+        COCAINE_LOG_WARNING(m_log, "unable to switch the app directory - %s", e.what());
+    }
+
+    // NOTE: The superseded slaves might still be finishing their sessions, so
+    // their version is only removed once it's superseded again.
+    discard(m_previous);
+
+    m_previous = m_path;
+    m_path = path;
+}
+
 namespace {
     static
     const char*
     describe[] = {
         "running",
+        "draining",
         "broken",
         "stopping",
         "stopped"
@@ -535,25 +2119,130 @@ namespace {
                    load;
         }
 
-        size_t
-        median() const {
-            return boost::accumulators::median(m_accumulator);
-        }
+        size_t
+        median() const {
+            return boost::accumulators::median(m_accumulator);
+        }
+
+        size_t
+        sum() const {
+            return boost::accumulators::sum(m_accumulator);
+        }
+
+    private:
+        boost::accumulators::accumulator_set<
+            size_t,
+            boost::accumulators::features<
+                boost::accumulators::tag::median,
+                boost::accumulators::tag::sum
+            >
+        > m_accumulator;
+    };
+}
+
+Json::Value
+engine_t::status() {
+    Json::Value info(Json::objectValue);
+
+    active_t active;
+
+    size_t active_pool_size = std::count_if(
+        m_pool.begin(),
+        m_pool.end(),
+        boost::bind(boost::ref(active), _1)
+    );
+
+    info["load-median"] = static_cast<Json::LargestUInt>(active.median());
+    info["queue-depth"] = static_cast<Json::LargestUInt>(m_queue.size());
+    info["queue-pending"] = static_cast<Json::LargestUInt>(m_pending.size());
+    info["sessions"]["pending"] = static_cast<Json::LargestUInt>(active.sum());
+    info["slaves"]["total"] = static_cast<Json::LargestUInt>(m_pool.size());
+    info["slaves"]["busy"] = static_cast<Json::LargestUInt>(active_pool_size);
+    info["slaves"]["retiring"] = static_cast<Json::LargestUInt>(
+        std::count_if(m_pool.begin(), m_pool.end(), retiring_t())
+    );
+    info["state"] = describe[static_cast<int>(m_state)];
+    info["generation"] = m_generation;
+
+    if(m_upgrade) {
+        info["upgrade"]["generation"] = m_upgrade->generation;
+        info["upgrade"]["target"] = static_cast<Json::LargestUInt>(m_upgrade->target);
+        info["upgrade"]["ready"] = static_cast<Json::LargestUInt>(
+            std::count_if(m_pool.begin(), m_pool.end(), ready_t(m_upgrade->generation))
+        );
+        info["upgrade"]["elapsed"] = m_loop.now() - m_upgrade->started;
+    }
+
+    if(m_state == state_t::draining) {
+        info["drain"]["total"] = static_cast<Json::LargestUInt>(m_drain_total);
+        info["drain"]["remaining"] = static_cast<Json::LargestUInt>(m_queue.size());
+        info["drain"]["elapsed"] = m_loop.now() - m_drain_started;
+        info["drain"]["timeout"] = m_profile->drain_timeout;
+    }
+
+    info["spawning"]["spawned"] = static_cast<Json::LargestUInt>(m_spawn_stats.spawned);
+    info["spawning"]["failed"] = static_cast<Json::LargestUInt>(m_spawn_stats.failed);
+    info["spawning"]["throttled"] = static_cast<Json::LargestUInt>(m_spawn_stats.throttled);
+    info["spawning"]["deferred"] = static_cast<Json::LargestUInt>(m_spawn_stats.deferred);
+    info["spawning"]["backoff"] = std::max(0.0, m_spawn_backoff - m_loop.now());
+    info["spawning"]["budget"]["used"] = static_cast<Json::LargestUInt>(m_context.spawns().used());
+    info["spawning"]["budget"]["limit"] = static_cast<Json::LargestUInt>(m_context.spawns().limit());
+
+    info["admission"] = m_admission->info();
+    info["hedging"] = m_hedging->info();
+    info["coalescing"] = m_coalescer->info();
+    info["caching"] = m_cache->info();
+    info["allocator"] = m_slab->info();
+    info["spool"] = m_spool->info();
+    info["compression"] = m_compressor.info();
+    info["latency"] = m_latency.info();
+
+    return info;
+}
+
+void
+engine_t::publish() {
+    boost::shared_ptr<const Json::Value> snapshot(boost::make_shared<Json::Value>(status()));
+
+    boost::atomic_store(&m_snapshot, snapshot);
+
+    m_published = m_loop.now();
+    m_dirty = false;
+}
+
+Json::Value
+engine_t::info() const {
+    boost::shared_ptr<const Json::Value> snapshot(boost::atomic_load(&m_snapshot));
+
+    if(!snapshot) {
+        Json::Value info(Json::objectValue);
+        info["error"] = "engine is not active";
+        return info;
+    }
+
+    return *snapshot;
+}
+
+void
+engine_t::on_snapshot(ev::check&, int) {
+    // NOTE: Otherwise, an idle engine would keep waking up just to rebuild the
+    // same snapshot.
+    if(!m_dirty) {
+        return;
+    }
 
-        size_t
-        sum() const {
-            return boost::accumulators::sum(m_accumulator);
-        }
+    const ev::tstamp elapsed = m_loop.now() - m_published;
 
-    private:
-        boost::accumulators::accumulator_set<
-            size_t,
-            boost::accumulators::features<
-                boost::accumulators::tag::median,
-                boost::accumulators::tag::sum
-            >
-        > m_accumulator;
-    };
+    if(elapsed >= defaults::status_interval) {
+        publish();
+    } else if(!m_snapshot_timer.is_active()) {
+        m_snapshot_timer.start(defaults::status_interval - elapsed);
+    }
+}
+
+void
+engine_t::on_snapshot_timeout(ev::timer&, int) {
+    publish();
 }
 
 void
@@ -567,33 +2256,18 @@ engine_t::process_ctl_events() {
     }
 
     switch(message_id) {
-        case event_traits<control::status>::id: {
-            Json::Value info(Json::objectValue);
-
-            active_t active;
-
-            size_t active_pool_size = std::count_if(
-                m_pool.begin(),
-                m_pool.end(),
-                boost::bind(boost::ref(active), _1)
-            );
-
-            info["load-median"] = static_cast<Json::LargestUInt>(active.median());
-            info["queue-depth"] = static_cast<Json::LargestUInt>(m_queue.size());
-            info["sessions"]["pending"] = static_cast<Json::LargestUInt>(active.sum());
-            info["slaves"]["total"] = static_cast<Json::LargestUInt>(m_pool.size());
-            info["slaves"]["busy"] = static_cast<Json::LargestUInt>(active_pool_size);
-            info["state"] = describe[static_cast<int>(m_state)];
-
-            m_ctl->send(info);
-
+        case event_traits<control::status>::id:
+            m_ctl->send(status());
             break;
-        }
 
         case event_traits<control::terminate>::id:
             migrate(state_t::stopping);
             break;
 
+        case event_traits<control::drain>::id:
+            drain();
+            break;
+
         default:
             COCAINE_LOG_ERROR(m_log, "received an unknown control message type %d", message_id);
             m_ctl->drop();
@@ -601,27 +2275,24 @@ engine_t::process_ctl_events() {
 }
 
 namespace {
-    struct load_t {
-        template<class T>
-        bool
-        operator()(const T& lhs, const T& rhs) const {
-            return lhs.second->load() < rhs.second->load();
-        }
-    };
-    
     struct available_t {
-        available_t(size_t max_):
-            max(max_)
+        available_t(size_t max_,
+                    unsigned int generation_):
+            max(max_),
+            generation(generation_)
         { }
 
         template<class T>
         bool
         operator()(const T& slave) const {
             return slave.second->state() == slave_t::state_t::active &&
+                   slave.second->generation() == generation &&
+                   !slave.second->retiring() &&
                    slave.second->load() < max;
         }
 
         const size_t max;
+        const unsigned int generation;
     };
 
     template<class It, class Compare, class Predicate>
@@ -651,6 +2322,32 @@ namespace {
     }
 }
 
+namespace {
+    frame_list_t
+    pack(const slave_t& slave,
+         const std::vector<boost::shared_ptr<session_t>>& batch,
+         const std::vector<uint64_t>& tags)
+    {
+        frame_list_t frames;
+
+        for(size_t i = 0; i < batch.size(); ++i) {
+            session_t& session = *batch[i];
+            const session_t::message_cache_t cache(session.cache());
+
+            frames.push_back(invocation(slave, tags[i], session.event));
+
+            for(session_t::message_cache_t::const_iterator it = cache.begin();
+                it != cache.end();
+                ++it)
+            {
+                frames.emplace_back(it->first, session_t::rebind(it->second, tags[i]));
+            }
+        }
+
+        return frames;
+    }
+}
+
 void
 engine_t::pump() {
     while(!m_queue.empty()) {
@@ -658,123 +2355,451 @@ engine_t::pump() {
             m_pool.begin(),
             m_pool.end(),
             load_t(),
-            available_t(m_profile.concurrency)
+            available_t(m_profile->concurrency, m_generation)
         );
 
         if(it == m_pool.end()) {
             return;
         }
 
-        session_queue_t::value_type session;
+        session_queue_t::value_type session(dequeue(false));
+
+        if(!session) {
+            return;
+        }
+
+        std::vector<session_queue_t::value_type> batch(1, session);
+
+        // NOTE: Sessions with complete in-memory requests are packed into a single
+        // invocation message, as long as they're at the queue head and the slave
+        // supports it.
+        if(m_profile->batch_size > 1 &&
+           it->second->supports(slave_t::features::batching) &&
+           session->cached())
+        {
+            const size_t limit = std::min(
+                m_profile->batch_size,
+                m_profile->concurrency - it->second->load()
+            );
 
-        do {
-            boost::unique_lock<session_queue_t> lock(m_queue);
+            while(batch.size() < limit) {
+                session = dequeue(true);
 
-            if(m_queue.empty()) {
-                return;
+                if(!session) {
+                    break;
+                }
+
+                batch.push_back(session);
             }
+        }
 
-            session = m_queue.front();
-            m_queue.pop_front();
+        std::vector<uint64_t> tags;
 
-            // Process the queue head outside the lock, because it might take
-            // some considerable amount of time if, for example, the session has
-            // expired and there's some heavy-lifting in the error handler.
-            lock.unlock();
+        tags.reserve(batch.size());
 
-            if(session->event.policy.deadline &&
-               session->event.policy.deadline <= m_loop.now())
-            {
-                COCAINE_LOG_DEBUG(
-                    m_log,
-                    "session %s has expired, dropping",
-                    session->id
-                );
+        for(size_t i = 0; i < batch.size(); ++i) {
+            tags.push_back(it->second->acquire());
+        }
 
-                session->upstream->error(
-                    deadline_error,
-                    "the session has expired in the queue"
-                );
+        bool success;
 
-                session.reset();
-            }
-        } while(!session);
+        if(batch.size() > 1) {
+            success = send<rpc::invoke_batch>(it->first, pack(*it->second, batch, tags));
+        } else {
+            const std::pair<int, std::string> invoke(
+                invocation(*it->second, tags.front(), batch.front()->event)
+            );
 
-        // Notify one of the blocked enqueue operations.
-        m_condition.notify_one();
-       
-        if(!send<rpc::invoke>(it->first, session->id, session->event.type)) {
+            success = send(it->first, invoke.first, invoke.second);
+        }
+
+        if(!success) {
             COCAINE_LOG_ERROR(
                 m_log,
                 "slave %s has unexpectedly died",
                 it->first
             );
 
+            for(size_t i = 0; i < tags.size(); ++i) {
+                it->second->discard(tags[i]);
+            }
+
+            // NOTE: The batch goes back to the queue, but the sessions which
+            // the slave has been already processing are lost.
+            it->second->abort(resource_error, "the slave has unexpectedly died");
+
             m_pool.erase(it);
 
             {
                 boost::unique_lock<session_queue_t> lock(m_queue);
-                m_queue.push_front(session);
+
+                // NOTE: Restore the original queue order.
+                m_queue.insert(m_queue.begin(), batch.begin(), batch.end());
             }
             
             continue;
         }
 
-        it->second->assign(std::move(session));
+        if(batch.size() > 1) {
+            COCAINE_LOG_DEBUG(
+                m_log,
+                "sent a batch of %llu sessions to slave %s",
+                batch.size(),
+                it->first
+            );
+        }
+
+        const int64_t now = latency_t::now();
+
+        for(size_t i = 0; i < batch.size(); ++i) {
+            m_latency.record(
+                batch[i]->event.type,
+                latency_t::queue,
+                now - batch[i]->birthstamp
+            );
+
+            if(m_hedging->eligible(batch[i]->event)) {
+                m_hedging->track(batch[i], it->first, m_loop.now());
+            }
+
+            // NOTE: Batched sessions have already had their caches delivered.
+            it->second->assign(std::move(batch[i]), tags[i], batch.size() == 1);
+        }
+
+        if(m_profile->max_sessions &&
+           it->second->processed() >= m_profile->max_sessions)
+        {
+            retire(it->first, "session limit reached");
+        }
 
         // TODO: Check if it helps.
         m_loop.feed_fd_event(m_bus->fd(), ev::READ);
     }
 }
 
+boost::shared_ptr<session_t>
+engine_t::dequeue(bool complete) {
+    session_queue_t::value_type session;
+
+    do {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+
+        if(m_queue.empty() || (complete && !m_queue.front()->cached())) {
+            return session_queue_t::value_type();
+        }
+
+        session = m_queue.front();
+        m_queue.pop_front();
+
+        pending_queue_t admitted;
+
+        if(!m_pending.empty()) {
+            promote(admitted);
+        }
+
+        // Process the queue head outside the lock, because it might take
+        // some considerable amount of time if, for example, the session has
+        // expired and there's some heavy-lifting in the error handler.
+        lock.unlock();
+
+        for(pending_queue_t::const_iterator it = admitted.begin();
+            it != admitted.end();
+            ++it)
+        {
+            it->second(downstream(it->first));
+        }
+
+        if(session->event.policy.deadline &&
+           session->event.policy.deadline <= m_loop.now())
+        {
+            COCAINE_LOG_DEBUG(
+                m_log,
+                "session %s has expired, dropping",
+                session->id
+            );
+
+            session->upstream->error(
+                deadline_error,
+                "the session has expired in the queue"
+            );
+
+            session.reset();
+        }
+    } while(!session);
+
+    return session;
+}
+
+unsigned long
+engine_t::queue_limit() const {
+    // NOTE: Under critical host pressure the queue is shortened, so that the load
+    // is shed early instead of having the sessions time out in the queue.
+    if(m_profile->queue_limit > 0 &&
+       m_context.pressure().level() == pressure_monitor_t::level_t::critical)
+    {
+        return std::max(1UL, m_profile->queue_limit / 2);
+    }
+
+    return m_profile->queue_limit;
+}
+
+bool
+engine_t::saturated(size_t incoming) const {
+    const unsigned long limit = queue_limit();
+
+    if(limit > 0 && m_queue.size() + incoming > limit) {
+        return true;
+    }
+
+    // NOTE: The bytes are only known for the sessions already in the queue, so
+    // the new ones are let in as long as there is any space left.
+    return m_profile->queue_bytes > 0 && m_spool->pending() >= m_profile->queue_bytes;
+}
+
+void
+engine_t::promote(pending_queue_t& admitted) {
+    while(!m_pending.empty() && !saturated()) {
+        m_queue.push(m_pending.front().first);
+
+        admitted.emplace_back(m_pending.front());
+        m_pending.pop_front();
+    }
+}
+
 void
 engine_t::balance() {
-    if(m_pool.size() >= m_profile.pool_limit ||
-       m_pool.size() * m_profile.grow_threshold >= m_queue.size())
+    if(m_pool.size() >= m_profile->pool_limit ||
+       m_pool.size() * m_profile->grow_threshold >= m_queue.size())
     {
         return;
     }
 
     unsigned int target = std::min(
-        m_profile.pool_limit,
+        m_profile->pool_limit,
         std::max(
             1UL,
-            m_queue.size() / m_profile.grow_threshold
+            m_queue.size() / m_profile->grow_threshold
         )
     );
   
-    if(target <= m_pool.size()) {
+    // NOTE: The node-wide slave limit is shared between the apps.
+    target = std::min<size_t>(target, report());
+
+    if(target <= m_pool.size() || m_loop.now() < m_spawn_backoff) {
         return;
     }
 
-    COCAINE_LOG_INFO(
-        m_log,
-        "enlarging the pool from %d to %d slaves",
+    const size_t size = m_pool.size();
+
+    while(m_pool.size() != target && spawn()) {
+        continue;
+    }
+
+    // NOTE: The pool might not grow at all if the spawn rate or the node-wide
+    // spawn budget is exhausted, in which case it's retried on the next event.
+    if(m_pool.size() != size) {
+        COCAINE_LOG_INFO(
+            m_log,
+            "enlarged the pool from %d to %d slaves",
+            size,
+            m_pool.size()
+        );
+    }
+}
+
+bool
+engine_t::spawn() {
+    // NOTE: New slaves would only make things worse for the overloaded host. The
+    // first one is still allowed under the elevated pressure, so that the app
+    // could make at least some progress.
+    const pressure_monitor_t::level_t pressure = m_context.pressure().level();
+
+    if(pressure == pressure_monitor_t::level_t::critical ||
+       (pressure == pressure_monitor_t::level_t::elevated && !m_pool.empty()))
+    {
+        ++m_spawn_stats.deferred;
+        return false;
+    }
+
+    return spawn(m_generation, m_manifest, m_profile, m_path);
+}
+
+bool
+engine_t::spawn(unsigned int generation,
+                const boost::shared_ptr<const manifest_t>& manifest,
+                const boost::shared_ptr<const profile_t>& profile,
+                const std::string& path)
+{
+    if(m_loop.now() < m_spawn_backoff) {
+        return false;
+    }
+
+    // NOTE: The budget slot is released by the slave once it has activated
+    // or died, see slave_t::rearm() and slave_t::terminate().
+    if(!m_context.spawns().acquire()) {
+        ++m_spawn_stats.throttled;
+        return false;
+    }
+
+    if(m_spawn_limiter && !m_spawn_limiter->consume()) {
+        m_context.spawns().release();
+        ++m_spawn_stats.throttled;
+        return false;
+    }
+
+    try {
+        boost::shared_ptr<slave_t> slave(
+            boost::make_shared<slave_t>(
+                m_context,
+                manifest,
+                profile,
+                generation,
+                path,
+                *this
+            )
+        );
+
+        m_pool.emplace(slave->id(), slave);
+    } catch(const cocaine::error_t& e) {
+        COCAINE_LOG_ERROR(m_log, "unable to spawn more slaves - %s", e.what());
+
+        m_context.spawns().release();
+        ++m_spawn_stats.failed;
+
+        backoff();
+
+        return false;
+    }
+
+    ++m_spawn_stats.spawned;
+
+    return true;
+}
+
+size_t
+engine_t::demand() const {
+    const size_t busy = std::count_if(m_pool.begin(), m_pool.end(), busy_t()),
+                 queued = (m_queue.size() + m_profile->grow_threshold - 1) / m_profile->grow_threshold;
+
+    return std::min(m_profile->pool_limit, busy + queued);
+}
+
+size_t
+engine_t::report() {
+    return m_context.pools().update(
+        m_manifest->name,
+        m_profile->weight,
+        demand(),
         m_pool.size(),
-        target
+        m_resident
     );
+}
 
-    while(m_pool.size() != target) {
-        try {
-            boost::shared_ptr<slave_t> slave(
-                boost::make_shared<slave_t>(
-                    m_context,
-                    m_manifest,
-                    m_profile,
-                    *this
-                )
-            );
+void
+engine_t::backoff() {
+    ++m_spawn_failures;
 
-            m_pool.emplace(slave->id(), slave);
-        } catch(const cocaine::error_t& e) {
-            COCAINE_LOG_ERROR(m_log, "unable to spawn more slaves - %s", e.what());
-            break;
-        }
+    if(m_profile->spawn_backoff == 0.0f) {
+        return;
+    }
+
+    // NOTE: Starting with a second, the delay is doubled on each consecutive
+    // failure until some slave finally activates.
+    const ev::tstamp delay = std::min<ev::tstamp>(
+        m_profile->spawn_backoff,
+        std::ldexp(1.0, std::min(m_spawn_failures - 1, 30U))
+    );
+
+    COCAINE_LOG_WARNING(
+        m_log,
+        "slaves have failed to activate %d times in a row, backing off for %.02f seconds",
+        m_spawn_failures,
+        delay
+    );
+
+    m_spawn_backoff = m_loop.now() + delay;
+}
+
+void
+engine_t::retire(const unique_id_t& slave_id,
+                 const std::string& reason,
+                 bool replace)
+{
+    pool_map_t::iterator it(m_pool.find(slave_id));
+
+    if(it == m_pool.end() ||
+       it->second->state() != slave_t::state_t::active ||
+       it->second->retiring())
+    {
+        return;
+    }
+
+    COCAINE_LOG_INFO(m_log, "retiring slave %s - %s", slave_id, reason);
+
+    it->second->retire();
+
+    // NOTE: The replacement is spawned right away, so that the pool capacity
+    // doesn't dip while the retiring slave is being drained. This means that
+    // the pool might temporarily exceed its limit.
+    if(replace && m_state == state_t::running) {
+        spawn(m_generation, m_manifest, m_profile, m_path);
+    }
+}
+
+void
+engine_t::drain() {
+    if(m_state != state_t::running) {
+        return;
+    }
+
+    if(m_profile->drain_timeout == 0.0f) {
+        migrate(state_t::stopping);
+        return;
+    }
+
+    boost::unique_lock<session_queue_t> lock(m_queue);
+
+    // NOTE: No new sessions are admitted from now on, but the queued ones are
+    // still dispatched to the slaves as usual.
+    m_state = state_t::draining;
+
+    pending_queue_t dropped;
+
+    m_pending.swap(dropped);
+
+    m_drain_started = m_loop.now();
+    m_drain_total = m_queue.size();
+
+    lock.unlock();
+
+    for(pending_queue_t::const_iterator it = dropped.begin();
+        it != dropped.end();
+        ++it)
+    {
+        it->second(boost::shared_ptr<api::stream_t>());
     }
+
+    COCAINE_LOG_INFO(
+        m_log,
+        "draining %llu queued %s, timeout: %.02f seconds",
+        m_drain_total,
+        m_drain_total == 1 ? "session" : "sessions",
+        m_profile->drain_timeout
+    );
+
+    m_drain_timer.set<engine_t, &engine_t::on_drain_timeout>(this);
+    m_drain_timer.start(m_profile->drain_timeout);
+
+    // Check if there's nothing to drain.
+    m_notification.send();
 }
 
 void
 engine_t::migrate(state_t target) {
+    if(m_drain_timer.is_active()) {
+        m_drain_timer.stop();
+    }
+
     boost::unique_lock<session_queue_t> lock(m_queue);
 
     m_state = target;
@@ -798,6 +2823,21 @@ engine_t::migrate(state_t target) {
         }
     }
 
+    pending_queue_t dropped;
+
+    // NOTE: The sessions which haven't been admitted yet are not reported to
+    // their upstreams, the same way as a synchronous enqueue() would throw.
+    m_pending.swap(dropped);
+
+    lock.unlock();
+
+    for(pending_queue_t::const_iterator it = dropped.begin();
+        it != dropped.end();
+        ++it)
+    {
+        it->second(boost::shared_ptr<api::stream_t>());
+    }
+
     unsigned int pending = 0;
 
     // NOTE: Send the termination event to the active slaves.
@@ -821,11 +2861,11 @@ engine_t::migrate(state_t target) {
             "waiting for %d active %s to terminate, timeout: %.02f seconds",
             pending,
             pending == 1 ? "slave" : "slaves",
-            m_profile.termination_timeout
+            m_profile->termination_timeout
         );
         
         m_termination_timer.set<engine_t, &engine_t::on_termination>(this);
-        m_termination_timer.start(m_profile.termination_timeout);
+        m_termination_timer.start(m_profile->termination_timeout);
     } else {
         stop();
     }    
@@ -837,11 +2877,43 @@ engine_t::stop() {
         m_termination_timer.stop();
     }
 
+    if(m_hedge_timer.is_active()) {
+        m_hedge_timer.stop();
+    }
+
+    if(m_snapshot_timer.is_active()) {
+        m_snapshot_timer.stop();
+    }
+
     // NOTE: This will force the slave pool termination.
     m_pool.clear();
 
+    // NOTE: With no slaves left, only the current app version is needed.
+    discard(m_previous);
+    m_previous.clear();
+
+    std::unique_ptr<upgrade_t> requested;
+
+    {
+        boost::unique_lock<session_queue_t> lock(m_queue);
+        requested = std::move(m_requested_upgrade);
+    }
+
+    if(requested) {
+        discard(requested->path);
+    }
+
+    if(m_upgrade) {
+        discard(m_upgrade->path);
+        m_upgrade.reset();
+    }
+
     if(m_state == state_t::stopping) {
         m_state = state_t::stopped;
         m_loop.unloop(ev::ALL);
     }
+
+    // NOTE: The loop might not get to the next iteration, so the final state
+    // is published right away.
+    publish();
 }
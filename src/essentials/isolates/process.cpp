@@ -26,9 +26,11 @@
 #include <cerrno>
 #include <csignal>
 #include <cstring>
+#include <fstream>
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 using namespace cocaine;
 using namespace cocaine::isolate;
@@ -57,6 +59,21 @@ namespace {
             }
         }
 
+        virtual
+        size_t
+        resident() const {
+            std::ifstream statm(cocaine::format("/proc/%d/statm", m_pid).c_str());
+
+            size_t total = 0,
+                   resident = 0;
+
+            if(!(statm >> total >> resident)) {
+                return 0;
+            }
+
+            return resident * ::sysconf(_SC_PAGESIZE);
+        }
+
     private:
         const pid_t m_pid;
     };
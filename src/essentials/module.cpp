@@ -25,6 +25,7 @@
 #include "cocaine/essentials/loggers/syslog.hpp"
 #include "cocaine/essentials/services/logging.hpp"
 #include "cocaine/essentials/services/node.hpp"
+#include "cocaine/essentials/storages/compressed.hpp"
 #include "cocaine/essentials/storages/files.hpp"
 
 using namespace cocaine;
@@ -39,6 +40,7 @@ extern "C" {
         repository.insert<logger::syslog_t>("syslog");
         repository.insert<service::logging_t>("logging");
         repository.insert<service::node_t>("node");
+        repository.insert<storage::compressed_t>("compressed");
         repository.insert<storage::files_t>("files");
     }
 }
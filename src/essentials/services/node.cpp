@@ -19,10 +19,13 @@
 */
 
 #include "cocaine/essentials/services/node.hpp"
+#include "cocaine/essentials/storages/compressed.hpp"
 
 #include "cocaine/app.hpp"
 #include "cocaine/context.hpp"
 #include "cocaine/logging.hpp"
+#include "cocaine/pool_arbiter.hpp"
+#include "cocaine/pressure.hpp"
 
 #include "cocaine/api/storage.hpp"
 
@@ -50,11 +53,14 @@ node_t::node_t(context_t& context,
     m_log(new log_t(context, name)),
     m_announces(context, ZMQ_PUB),
     m_announce_timer(loop()),
+    m_reap_timer(loop()),
     m_birthstamp(loop().now())
 {
     on<io::node::start_app>(boost::bind(&node_t::on_start_app, this, _1));
     on<io::node::pause_app>(boost::bind(&node_t::on_pause_app, this, _1));
     on<io::node::info>(boost::bind(&node_t::on_info, this));
+    on<io::node::upgrade_app>(boost::bind(&node_t::on_upgrade_app, this, _1));
+    on<io::node::reload_app>(boost::bind(&node_t::on_reload_app, this, _1));
     
     int minor, major, patch;
     zmq_version(&major, &minor, &patch);
@@ -94,6 +100,9 @@ node_t::node_t(context_t& context,
         m_announce_timer.start(0.0f, interval);
     }
 
+    m_reap_timer.set<node_t, &node_t::on_reap>(this);
+    m_reap_timer.start(1.0f, 1.0f);
+
     // Runlist
 
     runlist_t runlist;
@@ -128,9 +137,10 @@ node_t::node_t(context_t& context,
 }
 
 node_t::~node_t() {
-    if(!m_apps.empty()) {
+    if(!m_apps.empty() || !m_draining.empty()) {
         COCAINE_LOG_INFO(m_log, "stopping the apps");
         m_apps.clear();
+        m_draining.clear();
     }
 }
 
@@ -144,6 +154,23 @@ node_t::on_announce(ev::timer&, int) {
     );
 }
 
+void
+node_t::on_reap(ev::timer&, int) {
+    app_map_t::iterator it = m_draining.begin();
+
+    while(it != m_draining.end()) {
+        if(!it->second->drained()) {
+            ++it;
+            continue;
+        }
+
+        COCAINE_LOG_INFO(m_log, "the '%s' app has been drained", it->first);
+
+        it->second->stop();
+        it = m_draining.erase(it);
+    }
+}
+
 Json::Value
 node_t::on_start_app(const runlist_t& runlist) {
     Json::Value result(Json::objectValue);
@@ -158,6 +185,11 @@ node_t::on_start_app(const runlist_t& runlist) {
             continue;
         }
 
+        if(m_draining.find(it->first) != m_draining.end()) {
+            result[it->first] = "the app is being drained";
+            continue;
+        }
+
         COCAINE_LOG_INFO(m_log, "starting the '%s' app", it->first);
 
         try {
@@ -220,12 +252,95 @@ node_t::on_pause_app(const std::vector<std::string>& applist) {
             continue;
         }
 
-        COCAINE_LOG_INFO(m_log, "stopping the '%s' app", *it);
+        COCAINE_LOG_INFO(m_log, "draining the '%s' app", *it);
+
+        app->second->drain();
 
-        app->second->stop();
+        m_draining.insert(*app);
         m_apps.erase(app);
 
-        result[*it] = "the app has been stopped";
+        result[*it] = "the app is being drained";
+    }
+
+    return result;
+}
+
+Json::Value
+node_t::on_upgrade_app(const runlist_t& runlist) {
+    Json::Value result(Json::objectValue);
+
+    for(runlist_t::const_iterator it = runlist.begin();
+        it != runlist.end();
+        ++it)
+    {
+        app_map_t::iterator app(m_apps.find(it->first));
+
+        if(app == m_apps.end()) {
+            result[it->first] = "the app is not running";
+            continue;
+        }
+
+        COCAINE_LOG_INFO(m_log, "upgrading the '%s' app", it->first);
+
+        try {
+            app->second->upgrade(it->second);
+        } catch(const cocaine::error_t& e) {
+            COCAINE_LOG_ERROR(
+                m_log,
+                "unable to upgrade the '%s' app - %s",
+                it->first,
+                e.what()
+            );
+
+            result[it->first] = e.what();
+
+            continue;
+        }
+
+        result[it->first] = "the app is being upgraded";
+    }
+
+    return result;
+}
+
+Json::Value
+node_t::on_reload_app(const runlist_t& runlist) {
+    Json::Value result(Json::objectValue);
+
+    for(runlist_t::const_iterator it = runlist.begin();
+        it != runlist.end();
+        ++it)
+    {
+        app_map_t::iterator app(m_apps.find(it->first));
+
+        if(app == m_apps.end()) {
+            result[it->first] = "the app is not running";
+            continue;
+        }
+
+        COCAINE_LOG_INFO(
+            m_log,
+            "reloading the '%s' app with the '%s' profile",
+            it->first,
+            it->second
+        );
+
+        try {
+            app->second->reload(it->second);
+        } catch(const cocaine::error_t& e) {
+            COCAINE_LOG_ERROR(
+                m_log,
+                "unable to reload the '%s' app - %s",
+                it->first,
+                e.what()
+            );
+
+            result[it->first] = e.what();
+
+            continue;
+        }
+
+        result[it->first] = "the profile is being applied";
     }
 
     return result;
@@ -242,6 +357,19 @@ node_t::on_info() const {
         result["apps"][it->first] = it->second->info();
     }
 
+    for(app_map_t::const_iterator it = m_draining.begin();
+        it != m_draining.end(); 
+        ++it) 
+    {
+        result["apps"][it->first] = it->second->info();
+    }
+
+    if(m_context.pools().enabled()) {
+        result["pools"] = m_context.pools().info();
+    }
+
+    result["pressure"] = m_context.pressure().info();
+    result["storage-compression"] = storage::compressed_t::compressor().info();
     result["identity"] = m_context.config.network.hostname;
     result["uptime"] = loop().now() - m_birthstamp;
 
@@ -0,0 +1,128 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/essentials/storages/compressed.hpp"
+
+#include <cstring>
+
+using namespace cocaine;
+using namespace cocaine::storage;
+
+namespace {
+    // NOTE: Every object is prefixed with its encoding, and the compressed ones
+    // also with the original size.
+    static const char raw = 'R';
+    static const char lz4 = 'Z';
+}
+
+compressed_t::compressed_t(context_t& context,
+                           const std::string& name,
+                           const Json::Value& args):
+    category_type(context, name, args),
+    m_threshold(args.get("threshold", 1024).asUInt())
+{
+    const std::string backend(args["backend"].asString());
+
+    if(backend.empty() || backend == name) {
+        throw configuration_error_t("the '%s' storage backend is not valid", name);
+    }
+
+    m_backend = api::storage(context, backend);
+}
+
+std::string
+compressed_t::read(const std::string& collection,
+                   const std::string& key)
+{
+    const std::string frame(m_backend->get<std::string>(collection, key));
+
+    if(frame.empty()) {
+        throw storage_error_t("corrupted object");
+    }
+
+    if(frame[0] == raw) {
+        return frame.substr(1);
+    }
+
+    uint64_t original;
+
+    if(frame[0] != lz4 || frame.size() < 1 + sizeof(original)) {
+        throw storage_error_t("corrupted object");
+    }
+
+    std::memcpy(&original, frame.data() + 1, sizeof(original));
+
+    std::string blob;
+
+    try {
+        compressor().decompress(
+            frame.data() + 1 + sizeof(original),
+            frame.size() - 1 - sizeof(original),
+            original,
+            blob
+        );
+    } catch(const cocaine::error_t& e) {
+        throw storage_error_t("unable to decompress the object - %s", e.what());
+    }
+
+    return blob;
+}
+
+void
+compressed_t::write(const std::string& collection,
+                    const std::string& key,
+                    const std::string& blob)
+{
+    std::string packed;
+
+    if(blob.size() < m_threshold ||
+       !compressor().compress(blob.data(), blob.size(), packed))
+    {
+        m_backend->put(collection, key, raw + blob);
+        return;
+    }
+
+    const uint64_t original = blob.size();
+
+    std::string frame(1 + sizeof(original) + packed.size(), lz4);
+
+    std::memcpy(&frame[1], &original, sizeof(original));
+    std::memcpy(&frame[1 + sizeof(original)], packed.data(), packed.size());
+
+    m_backend->put(collection, key, frame);
+}
+
+std::vector<std::string>
+compressed_t::list(const std::string& collection) {
+    return m_backend->list(collection);
+}
+
+void
+compressed_t::remove(const std::string& collection,
+                     const std::string& key)
+{
+    m_backend->remove(collection, key);
+}
+
+compressor_t&
+compressed_t::compressor() {
+    static compressor_t instance;
+    return instance;
+}
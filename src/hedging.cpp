@@ -0,0 +1,369 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/hedging.hpp"
+
+#include "cocaine/engine.hpp"
+#include "cocaine/session.hpp"
+
+#include <algorithm>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace {
+    struct lane_t:
+        public api::stream_t
+    {
+        lane_t(const boost::shared_ptr<arbiter_t>& arbiter,
+               size_t index):
+            m_arbiter(arbiter),
+            m_index(index)
+        { }
+
+        virtual
+        void
+        push(const char * chunk,
+             size_t size)
+        {
+            m_arbiter->push(m_index, chunk, size);
+        }
+
+        virtual
+        void
+        error(error_code code,
+              const std::string& message)
+        {
+            m_arbiter->error(m_index, code, message);
+        }
+
+        virtual
+        void
+        close() {
+            m_arbiter->close(m_index);
+        }
+
+        virtual
+        bool
+        writable() {
+            return m_arbiter->upstream()->writable();
+        }
+
+        virtual
+        void
+        notify(const boost::function<void()>& callback) {
+            m_arbiter->upstream()->notify(callback);
+        }
+
+    public:
+        const boost::shared_ptr<arbiter_t>&
+        arbiter() const {
+            return m_arbiter;
+        }
+
+    private:
+        const boost::shared_ptr<arbiter_t> m_arbiter;
+        const size_t m_index;
+    };
+
+    static const size_t sample_limit = 1024;
+    static const size_t sample_threshold = 16;
+}
+
+// Arbiter
+
+arbiter_t::arbiter_t(engine_t& engine,
+                     const boost::shared_ptr<api::stream_t>& upstream):
+    m_engine(engine),
+    m_upstream(upstream),
+    m_lanes(0),
+    m_winner(none),
+    m_decided_at(0.0f)
+{ }
+
+boost::shared_ptr<api::stream_t>
+arbiter_t::lane() {
+    return boost::make_shared<lane_t>(shared_from_this(), m_lanes++);
+}
+
+void
+arbiter_t::bind(const boost::shared_ptr<session_t>& session) {
+    BOOST_ASSERT(m_sessions.size() < m_lanes);
+
+    m_sessions.push_back(session);
+}
+
+void
+arbiter_t::push(size_t lane,
+                const char * chunk,
+                size_t size)
+{
+    if(select(lane)) {
+        m_upstream->push(chunk, size);
+    }
+}
+
+void
+arbiter_t::error(size_t lane,
+                 error_code code,
+                 const std::string& message)
+{
+    if(select(lane)) {
+        m_upstream->error(code, message);
+    }
+}
+
+void
+arbiter_t::close(size_t lane) {
+    if(select(lane)) {
+        m_upstream->close();
+    }
+}
+
+bool
+arbiter_t::select(size_t lane) {
+    if(m_winner == none) {
+        m_winner = lane;
+        m_decided_at = m_engine.loop().now();
+
+        for(size_t i = 0; i < m_sessions.size(); ++i) {
+            const boost::shared_ptr<session_t> session = m_sessions[i].lock();
+
+            if(i != lane && session) {
+                m_engine.cancel(session);
+            }
+        }
+    }
+
+    return m_winner == lane;
+}
+
+// Hedging
+
+hedging_t::entry_t::entry_t(const boost::shared_ptr<session_t>& session_,
+                            const boost::shared_ptr<arbiter_t>& arbiter_,
+                            const unique_id_t& slave_,
+                            const frame_list_t& frames_,
+                            double dispatched_at_):
+    session(session_),
+    arbiter(arbiter_),
+    event(session_->event),
+    slave(slave_),
+    frames(frames_),
+    dispatched_at(dispatched_at_),
+    hedged(false)
+{ }
+
+hedging_t::hedging_t(const Json::Value& args):
+    m_percentile(args.get("percentile", 95.0f).asDouble()),
+    m_budget(args.get("budget", 0.05f).asDouble()),
+    m_burst(args.get("burst", 10.0f).asDouble()),
+    m_min_delay(args.get("min-delay", 0.005f).asDouble()),
+    m_interval(args.get("interval", 0.01f).asDouble()),
+    m_tokens(0.0f),
+    m_dispatched(0),
+    m_hedged(0),
+    m_won(0)
+{
+    const Json::Value events(args["events"]);
+
+    if(!events.isNull() && !events.isArray()) {
+        throw configuration_error_t("hedged events must be specified as an array");
+    }
+
+    for(Json::Value::const_iterator it = events.begin(); it != events.end(); ++it) {
+        m_events.insert((*it).asString());
+    }
+
+    if(m_percentile <= 0.0f || m_percentile > 100.0f) {
+        throw configuration_error_t("hedging percentile must be in the (0, 100] range");
+    }
+
+    if(m_budget <= 0.0f || m_budget > 1.0f) {
+        throw configuration_error_t("hedging budget must be in the (0, 1] range");
+    }
+
+    if(m_burst < 1.0f) {
+        throw configuration_error_t("hedging burst must be at least one session");
+    }
+
+    if(m_min_delay < 0.0f) {
+        throw configuration_error_t("hedging delay must be non-negative");
+    }
+
+    if(m_interval <= 0.0f) {
+        throw configuration_error_t("hedging interval must be positive");
+    }
+}
+
+bool
+hedging_t::eligible(const api::event_t& event) const {
+    return m_events.find(event.type) != m_events.end();
+}
+
+void
+hedging_t::track(const boost::shared_ptr<session_t>& session,
+                 const unique_id_t& slave,
+                 double now)
+{
+    const boost::shared_ptr<lane_t> lane(
+        boost::dynamic_pointer_cast<lane_t>(session->upstream)
+    );
+
+    // NOTE: Only the sessions with complete requests held in memory can be
+    // replayed, see session_t::cached().
+    if(!lane || !session->cached()) {
+        return;
+    }
+
+    m_tracked.emplace_back(session, lane->arbiter(), slave, session->cache(), now);
+
+    m_tokens = std::min(m_tokens + m_budget, m_burst);
+
+    ++m_dispatched;
+}
+
+void
+hedging_t::scan(double now,
+                std::vector<entry_t*>& due)
+{
+    std::map<std::string, double> delays;
+
+    std::list<entry_t>::iterator it = m_tracked.begin();
+
+    while(it != m_tracked.end()) {
+        if(it->arbiter->decided()) {
+            sample(it->event.type, it->arbiter->decided_at() - it->dispatched_at);
+
+            if(it->hedged && it->arbiter->winner() != 0) {
+                ++m_won;
+            }
+
+            it = m_tracked.erase(it);
+
+            continue;
+        }
+
+        const boost::shared_ptr<session_t> session(it->session.lock());
+
+        if(!session || session->cancelled()) {
+            it = m_tracked.erase(it);
+            continue;
+        }
+
+        if(!it->hedged) {
+            std::map<std::string, double>::iterator delay(delays.find(it->event.type));
+
+            if(delay == delays.end()) {
+                delay = delays.insert(
+                    std::make_pair(it->event.type, this->delay(it->event.type))
+                ).first;
+            }
+
+            if(delay->second >= 0.0f && now - it->dispatched_at >= delay->second) {
+                due.push_back(&*it);
+            }
+        }
+
+        ++it;
+    }
+}
+
+bool
+hedging_t::acquire() {
+    if(m_tokens < 1.0f) {
+        return false;
+    }
+
+    m_tokens -= 1.0f;
+
+    ++m_hedged;
+
+    return true;
+}
+
+hedging_t::frame_list_t
+hedging_t::replay(const entry_t& entry,
+                  uint64_t tag)
+{
+    frame_list_t frames;
+
+    for(frame_list_t::const_iterator it = entry.frames.begin();
+        it != entry.frames.end();
+        ++it)
+    {
+        frames.emplace_back(it->first, session_t::rebind(it->second, tag));
+    }
+
+    return frames;
+}
+
+Json::Value
+hedging_t::info() const {
+    Json::Value info(Json::objectValue);
+
+    info["dispatched"] = static_cast<Json::LargestUInt>(m_dispatched);
+    info["hedged"] = static_cast<Json::LargestUInt>(m_hedged);
+    info["won"] = static_cast<Json::LargestUInt>(m_won);
+    info["rate"] = m_dispatched ? static_cast<double>(m_hedged) / m_dispatched : 0.0f;
+
+    for(std::map<std::string, samples_t>::const_iterator it = m_samples.begin();
+        it != m_samples.end();
+        ++it)
+    {
+        info["delays"][it->first] = delay(it->first);
+    }
+
+    return info;
+}
+
+double
+hedging_t::delay(const std::string& event) const {
+    std::map<std::string, samples_t>::const_iterator it(m_samples.find(event));
+
+    // NOTE: Don't hedge until there's enough statistics to estimate the delay.
+    if(it == m_samples.end() || it->second.ring.size() < sample_threshold) {
+        return -1.0f;
+    }
+
+    std::vector<double> samples(it->second.ring);
+
+    std::vector<double>::iterator nth = samples.begin() + static_cast<size_t>(
+        m_percentile / 100.0f * (samples.size() - 1)
+    );
+
+    std::nth_element(samples.begin(), nth, samples.end());
+
+    return std::max(m_min_delay, *nth);
+}
+
+void
+hedging_t::sample(const std::string& event,
+                  double latency)
+{
+    samples_t& samples = m_samples[event];
+
+    if(samples.ring.size() < sample_limit) {
+        samples.ring.push_back(latency);
+    } else {
+        samples.ring[samples.next] = latency;
+        samples.next = (samples.next + 1) % sample_limit;
+    }
+}
@@ -0,0 +1,217 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/histogram.hpp"
+
+#include <cmath>
+#include <ctime>
+
+using namespace cocaine::engine;
+
+// Histogram
+
+histogram_t::histogram_t():
+    m_count(0),
+    m_max(0)
+{
+    m_buckets.fill(0);
+}
+
+void
+histogram_t::record(int64_t nanoseconds) {
+    // NOTE: Sub-microsecond durations are counted as zeroes, the negative ones
+    // might only come from the clock skew between the threads.
+    uint64_t value = nanoseconds > 0 ? nanoseconds / 1000 : 0;
+
+    value = std::min<uint64_t>(value, (1ULL << magnitude) - 1);
+
+    ++m_buckets[index(value)];
+    ++m_count;
+
+    m_max = std::max(m_max, value);
+}
+
+double
+histogram_t::percentile(double fraction) const {
+    if(!m_count) {
+        return 0.0f;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(
+        1,
+        static_cast<uint64_t>(std::ceil(fraction * m_count))
+    );
+
+    uint64_t seen = 0;
+
+    for(size_t i = 0; i < buckets; ++i) {
+        seen += m_buckets[i];
+
+        if(seen >= rank) {
+            return std::min(midpoint(i), m_max) / 1e6;
+        }
+    }
+
+    return m_max / 1e6;
+}
+
+Json::Value
+histogram_t::info() const {
+    Json::Value info(Json::objectValue);
+
+    info["count"] = static_cast<Json::LargestUInt>(m_count);
+    info["p50"] = percentile(0.5f);
+    info["p90"] = percentile(0.9f);
+    info["p99"] = percentile(0.99f);
+    info["p999"] = percentile(0.999f);
+    info["max"] = m_max / 1e6;
+
+    return info;
+}
+
+size_t
+histogram_t::index(uint64_t value) {
+    if(value < (1ULL << precision)) {
+        return value;
+    }
+
+    const unsigned int exponent = 63 - __builtin_clzll(value);
+    const unsigned int shift = exponent - precision;
+
+    return ((shift + 1) << precision) + ((value >> shift) - (1ULL << precision));
+}
+
+uint64_t
+histogram_t::midpoint(size_t index) {
+    if(index < (1ULL << precision)) {
+        return index;
+    }
+
+    const unsigned int shift = (index >> precision) - 1;
+    const uint64_t lower = ((1ULL << precision) + (index & ((1ULL << precision) - 1))) << shift;
+
+    return lower + ((1ULL << shift) >> 1);
+}
+
+// Latency
+
+latency_t::timings_t::timings_t():
+    window_start(latency_t::now()),
+    window_count(0),
+    throughput(0.0f)
+{ }
+
+void
+latency_t::timings_t::record(stages stage,
+                             int64_t nanoseconds)
+{
+    histograms[stage].record(nanoseconds);
+
+    if(stage == completion) {
+        ++window_count;
+    }
+}
+
+Json::Value
+latency_t::timings_t::info(int64_t now) {
+    const int64_t elapsed = now - window_start;
+
+    if(elapsed >= 1000000000LL) {
+        throughput = window_count * 1e9 / elapsed;
+        window_start = now;
+        window_count = 0;
+    }
+
+    Json::Value info(Json::objectValue);
+
+    info["queue"] = histograms[queue].info();
+    info["response"] = histograms[response].info();
+    info["completion"] = histograms[completion].info();
+    info["throughput"] = throughput;
+
+    return info;
+}
+
+latency_t::latency_t():
+    m_tracked(0),
+    m_untracked(0)
+{ }
+
+int64_t
+latency_t::now() {
+    timespec ts;
+
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void
+latency_t::record(const symbol_t& event,
+                  stages stage,
+                  int64_t nanoseconds)
+{
+    m_total.record(stage, nanoseconds);
+
+    if(!event.interned()) {
+        ++m_untracked;
+        return;
+    }
+
+    const size_t id = event.id();
+
+    if(id >= m_events.size()) {
+        m_events.resize(id + 1);
+    }
+
+    if(!m_events[id]) {
+        if(m_tracked == max_events) {
+            ++m_untracked;
+            return;
+        }
+
+        m_events[id].reset(new timings_t());
+        m_events[id]->name = event.str();
+
+        ++m_tracked;
+    }
+
+    m_events[id]->record(stage, nanoseconds);
+}
+
+Json::Value
+latency_t::info() {
+    Json::Value info(Json::objectValue),
+                events(Json::objectValue);
+
+    const int64_t now = latency_t::now();
+
+    for(size_t id = 0; id < m_events.size(); ++id) {
+        if(m_events[id]) {
+            events[m_events[id]->name] = m_events[id]->info(now);
+        }
+    }
+
+    info["total"] = m_total.info(now);
+    info["events"] = events;
+    info["untracked"] = static_cast<Json::LargestUInt>(m_untracked);
+
+    return info;
+}
@@ -0,0 +1,289 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/memfd.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+ #include <linux/memfd.h>
+#endif
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+memfd_t::memfd_t(int fd,
+                 size_t size):
+    m_fd(fd),
+    m_size(size),
+    m_data(NULL)
+{
+    const int seals = ::fcntl(m_fd, F_GET_SEALS);
+
+    // NOTE: Without the seals, the peer could still shrink the file or change
+    // its contents under the mapping after it has been checked.
+    if(seals == -1 || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) != (F_SEAL_SHRINK | F_SEAL_WRITE)) {
+        ::close(m_fd);
+        throw cocaine::error_t("the memory file is not sealed");
+    }
+
+    struct stat info;
+
+    // NOTE: The peer could have lied about the size, and a mapping beyond the
+    // end of the file would crash the engine on access.
+    if(::fstat(m_fd, &info) != 0 || static_cast<size_t>(info.st_size) < m_size) {
+        ::close(m_fd);
+        throw cocaine::error_t("the memory file is smaller than announced");
+    }
+
+    if(!m_size) {
+        return;
+    }
+
+    void * data = ::mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+    if(data == MAP_FAILED) {
+        const int error = errno;
+
+        ::close(m_fd);
+
+        throw cocaine::error_t("unable to map the memory file - %s", ::strerror(error));
+    }
+
+    m_data = static_cast<char*>(data);
+}
+
+memfd_t::~memfd_t() {
+    if(m_data) {
+        ::munmap(m_data, m_size);
+    }
+
+    ::close(m_fd);
+}
+
+int
+memfd_t::create(const char * data,
+                size_t size)
+{
+    const int fd = ::syscall(SYS_memfd_create, "cocaine", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if(fd == -1) {
+        return -1;
+    }
+
+    size_t written = 0;
+
+    while(written != size) {
+        const ssize_t result = ::write(fd, data + written, size - written);
+
+        if(result == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            ::close(fd);
+            return -1;
+        }
+
+        written += result;
+    }
+
+    // NOTE: The seals guarantee the consumer that the body won't change or
+    // shrink under its mapping once the descriptor has been passed.
+    if(::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+fd_channel_t::fd_channel_t(const std::string& path,
+                           size_t threshold,
+                           ev::loop_ref& loop):
+    m_path(path),
+    m_threshold(threshold),
+    m_listener(-1),
+    m_socket(-1),
+    m_watcher(loop)
+{
+    struct sockaddr_un address;
+
+    if(m_path.size() >= sizeof(address.sun_path)) {
+        throw cocaine::error_t("the socket path '%s' is too long", m_path);
+    }
+
+    std::memset(&address, 0, sizeof(address));
+
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, m_path.c_str());
+
+    m_listener = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if(m_listener == -1) {
+        throw cocaine::error_t("unable to create a socket - %s", ::strerror(errno));
+    }
+
+    if(::bind(m_listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+       ::listen(m_listener, 1) != 0)
+    {
+        const int error = errno;
+
+        ::close(m_listener);
+        ::unlink(m_path.c_str());
+
+        throw cocaine::error_t(
+            "unable to listen on the socket '%s' - %s",
+            m_path,
+            ::strerror(error)
+        );
+    }
+
+    m_watcher.set<fd_channel_t, &fd_channel_t::on_connection>(this);
+    m_watcher.start(m_listener, ev::READ);
+}
+
+fd_channel_t::~fd_channel_t() {
+    m_watcher.stop();
+
+    if(m_listener != -1) {
+        ::close(m_listener);
+        ::unlink(m_path.c_str());
+    }
+
+    if(m_socket != -1) {
+        ::close(m_socket);
+    }
+}
+
+void
+fd_channel_t::on_connection(ev::io&, int) {
+    // NOTE: The descriptors are sent from the driver threads with the channel
+    // locked, so a slave which doesn't take them must not block the sender.
+    const int socket = ::accept4(m_listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if(socket == -1) {
+        return;
+    }
+
+    // NOTE: Only a single connection is ever accepted, so the listener is gone
+    // as soon as the slave has connected.
+    m_watcher.stop();
+
+    ::close(m_listener);
+    ::unlink(m_path.c_str());
+
+    m_listener = -1;
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    m_socket = socket;
+}
+
+bool
+fd_channel_t::send(int fd) {
+    char marker = 0;
+
+    struct iovec iov = { &marker, sizeof(marker) };
+
+    char control[CMSG_SPACE(sizeof(int))];
+
+    std::memset(control, 0, sizeof(control));
+
+    struct msghdr message;
+
+    std::memset(&message, 0, sizeof(message));
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+
+    std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    ssize_t result;
+
+    do {
+        result = ::sendmsg(m_socket, &message, MSG_NOSIGNAL);
+    } while(result == -1 && errno == EINTR);
+
+    return result == sizeof(marker);
+}
+
+int
+fd_channel_t::recv() {
+    if(m_socket == -1) {
+        throw cocaine::error_t("the slave is not connected to the descriptor channel");
+    }
+
+    char marker;
+
+    struct iovec iov = { &marker, sizeof(marker) };
+
+    char control[CMSG_SPACE(sizeof(int))];
+
+    struct msghdr message;
+
+    std::memset(&message, 0, sizeof(message));
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t result;
+
+    // NOTE: The descriptor is sent before its announcement, so it must already
+    // be there, and the channel would never block the engine.
+    do {
+        result = ::recvmsg(m_socket, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    } while(result == -1 && errno == EINTR);
+
+    struct cmsghdr * header = result == 1 ? CMSG_FIRSTHDR(&message) : NULL;
+
+    if(!header ||
+       header->cmsg_level != SOL_SOCKET ||
+       header->cmsg_type != SCM_RIGHTS ||
+       header->cmsg_len != CMSG_LEN(sizeof(int)))
+    {
+        throw cocaine::error_t("the descriptor channel is out of sync");
+    }
+
+    int fd;
+
+    std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+
+    return fd;
+}
@@ -0,0 +1,279 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/pool_arbiter.hpp"
+
+#include <cmath>
+#include <limits>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+pool_arbiter_t::pool_arbiter_t(unsigned long slaves,
+                               unsigned long memory):
+    m_slaves(slaves),
+    m_memory(memory),
+    m_epoch(0)
+{ }
+
+size_t
+pool_arbiter_t::update(const std::string& name,
+                       double weight,
+                       size_t demand,
+                       size_t size,
+                       size_t resident)
+{
+    if(!enabled()) {
+        return std::numeric_limits<size_t>::max();
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    entry_t& entry = m_entries[name];
+
+    entry.weight = weight;
+    entry.demand = demand;
+    entry.size = size;
+    entry.resident = resident;
+
+    rebalance();
+
+    return entry.share;
+}
+
+void
+pool_arbiter_t::remove(const std::string& name) {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    m_entries.erase(name);
+
+    rebalance();
+}
+
+Json::Value
+pool_arbiter_t::info() const {
+    Json::Value info(Json::objectValue);
+
+    info["limits"]["slaves"] = static_cast<Json::LargestUInt>(m_slaves);
+    info["limits"]["memory"] = static_cast<Json::LargestUInt>(m_memory);
+
+    size_t size = 0,
+           resident = 0;
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    for(entry_map_t::const_iterator it = m_entries.begin();
+        it != m_entries.end();
+        ++it)
+    {
+        Json::Value& app(info["apps"][it->first]);
+
+        app["weight"] = it->second.weight;
+        app["demand"] = static_cast<Json::LargestUInt>(it->second.demand);
+        app["slaves"] = static_cast<Json::LargestUInt>(it->second.size);
+        app["share"] = static_cast<Json::LargestUInt>(it->second.share);
+
+        size += it->second.size;
+        resident += it->second.resident;
+    }
+
+    info["slaves"] = static_cast<Json::LargestUInt>(size);
+    info["resident"] = static_cast<Json::LargestUInt>(resident);
+
+    return info;
+}
+
+namespace {
+    struct priority_t {
+        template<class T>
+        bool
+        operator()(const T * lhs, const T * rhs) const {
+            // NOTE: The apps which have neither slaves nor a share go first, then
+            // the ones with the largest fractional shares. Ties are broken in favor
+            // of the apps which already have more slaves, so that the shares don't
+            // flip between the unequal apps, and then by the least recent grant.
+            const bool lhs_starved = lhs->size == 0 && lhs->share == 0,
+                       rhs_starved = rhs->size == 0 && rhs->share == 0;
+
+            if(lhs_starved != rhs_starved) {
+                return lhs_starved;
+            }
+
+            const double lhs_remainder = lhs->fair - std::floor(lhs->fair),
+                         rhs_remainder = rhs->fair - std::floor(rhs->fair);
+
+            if(lhs_remainder != rhs_remainder) {
+                return lhs_remainder > rhs_remainder;
+            }
+
+            if(lhs->size != rhs->size) {
+                return lhs->size > rhs->size;
+            }
+
+            return lhs->granted < rhs->granted;
+        }
+    };
+}
+
+void
+pool_arbiter_t::rebalance() {
+    size_t capacity = m_slaves ? m_slaves : std::numeric_limits<size_t>::max(),
+           size = 0,
+           resident = 0;
+
+    for(entry_map_t::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        size += it->second.size;
+        resident += it->second.resident;
+    }
+
+    // NOTE: Once the memory limit is reached, the apps can only trade the slaves
+    // they already have between each other.
+    if(m_memory && resident >= m_memory) {
+        capacity = std::min(capacity, size);
+    }
+
+    std::vector<entry_t*> hungry;
+
+    for(entry_map_t::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        it->second.fair = 0.0f;
+
+        if(capacity == std::numeric_limits<size_t>::max()) {
+            it->second.share = capacity;
+        } else if(it->second.demand) {
+            hungry.push_back(&it->second);
+        }
+    }
+
+    if(capacity == std::numeric_limits<size_t>::max()) {
+        return;
+    }
+
+    // NOTE: Water-filling. The capacity is split in proportion to the weights,
+    // the apps which need less than their split get exactly what they need, and
+    // the rest is split again among the others until nothing is left.
+    double remaining = capacity;
+    std::vector<entry_t*> unsatisfied;
+
+    while(!hungry.empty() && remaining > 0.0f) {
+        double weights = 0.0f,
+               granted = 0.0f;
+
+        for(std::vector<entry_t*>::const_iterator it = hungry.begin(); it != hungry.end(); ++it) {
+            weights += (*it)->weight;
+        }
+
+        unsatisfied.clear();
+
+        for(std::vector<entry_t*>::const_iterator it = hungry.begin(); it != hungry.end(); ++it) {
+            const double split = remaining * (*it)->weight / weights,
+                         wanted = (*it)->demand - (*it)->fair;
+
+            if(wanted <= split) {
+                (*it)->fair = (*it)->demand;
+                granted += wanted;
+            } else {
+                unsatisfied.push_back(*it);
+            }
+        }
+
+        if(unsatisfied.size() == hungry.size()) {
+            for(std::vector<entry_t*>::const_iterator it = hungry.begin(); it != hungry.end(); ++it) {
+                (*it)->fair += remaining * (*it)->weight / weights;
+            }
+
+            break;
+        }
+
+        remaining -= granted;
+        hungry.swap(unsatisfied);
+    }
+
+    size_t spare = capacity;
+
+    std::vector<entry_t*> rounding;
+
+    for(entry_map_t::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        it->second.share = static_cast<size_t>(std::floor(it->second.fair));
+        spare -= it->second.share;
+
+        if(it->second.share < it->second.demand) {
+            rounding.push_back(&it->second);
+        }
+    }
+
+    // NOTE: The slaves lost to rounding are handed out one by one, first to the
+    // apps with empty pools, so that every app with some demand gets at least one
+    // slave as long as the capacity allows it, see the priority order above.
+    std::sort(rounding.begin(), rounding.end(), priority_t());
+
+    for(std::vector<entry_t*>::const_iterator it = rounding.begin();
+        it != rounding.end() && spare;
+        ++it)
+    {
+        ++(*it)->share;
+        --spare;
+    }
+
+    // NOTE: If there's still an app with an empty pool and no share, it takes a
+    // slave from the app with the largest share, unless that would leave it with
+    // no slaves either.
+    for(std::vector<entry_t*>::const_iterator it = rounding.begin(); it != rounding.end(); ++it) {
+        if((*it)->size != 0 || (*it)->share != 0) {
+            continue;
+        }
+
+        entry_t * donor = NULL;
+
+        for(entry_map_t::iterator jt = m_entries.begin(); jt != m_entries.end(); ++jt) {
+            if(jt->second.share > 1 && (!donor || jt->second.share > donor->share)) {
+                donor = &jt->second;
+            }
+        }
+
+        if(!donor) {
+            break;
+        }
+
+        --donor->share;
+        ++(*it)->share;
+    }
+
+    ++m_epoch;
+
+    for(entry_map_t::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if(it->second.demand && it->second.share) {
+            it->second.granted = m_epoch;
+        }
+    }
+
+    // NOTE: Whatever is left lets the apps keep the slaves they don't currently
+    // need, so that they're not reclaimed unless some other app needs them.
+    for(entry_map_t::iterator it = m_entries.begin();
+        it != m_entries.end() && spare;
+        ++it)
+    {
+        if(it->second.size > it->second.share) {
+            const size_t extra = std::min(spare, it->second.size - it->second.share);
+
+            it->second.share += extra;
+            spare -= extra;
+        }
+    }
+}
@@ -0,0 +1,176 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/pressure.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+using namespace cocaine;
+
+namespace {
+    // NOTE: The critical stall percentage is twice the threshold, but no more
+    // than halfway between the threshold and a complete stall, so that it's
+    // still reachable with the higher thresholds.
+    double
+    critical(double threshold) {
+        return std::min(2 * threshold, (threshold + 100.0f) / 2);
+    }
+
+    // NOTE: Reads the "some avg10" field, the percentage of time in the last
+    // ten seconds some tasks were stalled on the resource.
+    bool
+    stall(const std::string& path,
+          double& result)
+    {
+        std::ifstream stream(path.c_str());
+        std::string line;
+
+        while(std::getline(stream, line)) {
+            std::istringstream tokens(line);
+            std::string kind, field;
+
+            if(!(tokens >> kind >> field) || kind != "some") {
+                continue;
+            }
+
+            if(field.compare(0, 6, "avg10=") != 0) {
+                return false;
+            }
+
+            std::istringstream value(field.substr(6));
+
+            return static_cast<bool>(value >> result);
+        }
+
+        return false;
+    }
+
+    // NOTE: Returns the fraction of memory available for the new processes
+    // without swapping.
+    bool
+    available(double& result) {
+        std::ifstream stream("/proc/meminfo");
+        std::string key;
+        unsigned long long value, total = 0, free = 0;
+
+        while(stream >> key >> value) {
+            if(key == "MemTotal:") {
+                total = value;
+            } else if(key == "MemAvailable:") {
+                free = value;
+            }
+
+            // Skip the units.
+            stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+
+        if(!total) {
+            return false;
+        }
+
+        result = static_cast<double>(free) / total;
+
+        return true;
+    }
+}
+
+pressure_monitor_t::pressure_monitor_t(const config_t& config):
+    m_memory_threshold(config.pressure.memory),
+    m_cpu_threshold(config.pressure.cpu),
+    m_available_threshold(config.pressure.available),
+    m_level(static_cast<int>(level_t::normal)),
+    m_memory(0.0f),
+    m_cpu(0.0f),
+    m_available(1.0f),
+    m_psi(false)
+{ }
+
+void
+pressure_monitor_t::sample() {
+    double memory = 0.0f,
+           cpu = 0.0f,
+           free = 1.0f;
+
+    const bool psi = stall("/proc/pressure/memory", memory) &&
+                     stall("/proc/pressure/cpu", cpu);
+
+    available(free);
+
+    level_t level = level_t::normal;
+
+    // NOTE: Each threshold is checked twice, first for the elevated level and
+    // then for the critical one, see critical() above. The available memory
+    // threshold works the other way round, its critical level is a half of it.
+    if((m_memory_threshold && memory >= m_memory_threshold) ||
+       (m_cpu_threshold && cpu >= m_cpu_threshold) ||
+       (m_available_threshold && free <= m_available_threshold))
+    {
+        level = level_t::elevated;
+    }
+
+    if((m_memory_threshold && memory >= critical(m_memory_threshold)) ||
+       (m_cpu_threshold && cpu >= critical(m_cpu_threshold)) ||
+       (m_available_threshold && free <= m_available_threshold / 2))
+    {
+        level = level_t::critical;
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        m_memory = memory;
+        m_cpu = cpu;
+        m_available = free;
+        m_psi = psi;
+    }
+
+    m_level = static_cast<int>(level);
+}
+
+namespace {
+    static
+    const char*
+    describe[] = {
+        "normal",
+        "elevated",
+        "critical"
+    };
+}
+
+Json::Value
+pressure_monitor_t::info() const {
+    Json::Value info(Json::objectValue);
+
+    info["level"] = describe[m_level.load()];
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    if(m_psi) {
+        info["memory"] = m_memory;
+        info["cpu"] = m_cpu;
+    }
+
+    info["available"] = m_available;
+
+    return info;
+}
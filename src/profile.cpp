@@ -65,6 +65,15 @@ profile_t::profile_t(context_t& context,
         throw configuration_error_t("engine termination timeout must be non-negative");
     }
             
+    drain_timeout = get(
+        "drain-timeout",
+        defaults::drain_timeout
+    ).asDouble();
+
+    if(drain_timeout < 0.0f) {
+        throw configuration_error_t("engine drain timeout must be non-negative");
+    }
+
     pool_limit = get(
         "pool-limit",
         static_cast<Json::UInt>(defaults::pool_limit)
@@ -79,6 +88,21 @@ profile_t::profile_t(context_t& context,
         static_cast<Json::UInt>(defaults::queue_limit)
     ).asUInt();
 
+    pending_limit = get(
+        "pending-limit",
+        static_cast<Json::UInt>(defaults::pending_limit)
+    ).asUInt();
+
+    queue_bytes = get(
+        "queue-bytes",
+        static_cast<Json::LargestUInt>(defaults::queue_bytes)
+    ).asLargestUInt();
+
+    queue_memory = get(
+        "queue-memory",
+        static_cast<Json::LargestUInt>(defaults::queue_memory)
+    ).asLargestUInt();
+
     concurrency = get(
         "concurrency",
         static_cast<Json::UInt>(defaults::concurrency)
@@ -88,6 +112,72 @@ profile_t::profile_t(context_t& context,
         throw configuration_error_t("engine concurrency must be positive");
     }
 
+    batch_size = get(
+        "batch-size",
+        static_cast<Json::UInt>(defaults::batch_size)
+    ).asUInt();
+
+    if(batch_size == 0) {
+        throw configuration_error_t("engine batch size must be positive");
+    }
+
+    session_window = get(
+        "session-window",
+        static_cast<Json::UInt>(defaults::session_window)
+    ).asUInt();
+
+    shm_ring = get(
+        "shm-ring",
+        static_cast<Json::LargestUInt>(defaults::shm_ring)
+    ).asLargestUInt();
+
+    fd_threshold = get(
+        "fd-threshold",
+        static_cast<Json::LargestUInt>(defaults::fd_threshold)
+    ).asLargestUInt();
+
+    compression_threshold = get(
+        "compression-threshold",
+        static_cast<Json::LargestUInt>(defaults::compression_threshold)
+    ).asLargestUInt();
+
+    max_sessions = get(
+        "max-sessions",
+        static_cast<Json::UInt>(defaults::max_sessions)
+    ).asUInt();
+
+    max_rss = get(
+        "max-rss",
+        static_cast<Json::LargestUInt>(defaults::max_rss)
+    ).asLargestUInt();
+
+    spawn_rate = get(
+        "spawn-rate",
+        defaults::spawn_rate
+    ).asDouble();
+
+    if(spawn_rate < 0.0f) {
+        throw configuration_error_t("engine spawn rate must be non-negative");
+    }
+
+    spawn_backoff = get(
+        "spawn-backoff",
+        defaults::spawn_backoff
+    ).asDouble();
+
+    if(spawn_backoff < 0.0f) {
+        throw configuration_error_t("engine spawn backoff must be non-negative");
+    }
+
+    weight = get(
+        "weight",
+        defaults::weight
+    ).asDouble();
+
+    if(weight <= 0.0f) {
+        throw configuration_error_t("engine weight must be positive");
+    }
+
     grow_threshold = get(
         "grow-threshold",
         std::max(
@@ -102,5 +192,21 @@ profile_t::profile_t(context_t& context,
         (*this)["isolate"].get("type", "process").asString(),
         (*this)["isolate"]["args"]
     };
+
+    // Admission control
+
+    admission = (*this)["admission"];
+
+    // Request hedging
+
+    hedging = (*this)["hedging"];
+
+    // Request coalescing
+
+    coalescing = (*this)["coalescing"];
+
+    // Response caching
+
+    caching = (*this)["caching"];
 }
 
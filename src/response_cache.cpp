@@ -0,0 +1,276 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/response_cache.hpp"
+
+#include "cocaine/api/stream.hpp"
+
+#include <ctime>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace {
+    double
+    now() {
+        timespec ts;
+
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    size_t
+    measure(const std::string& key,
+            const response_cache_t::chunk_list_t& response)
+    {
+        size_t size = key.size();
+
+        for(response_cache_t::chunk_list_t::const_iterator it = response.begin();
+            it != response.end();
+            ++it)
+        {
+            size += it->size();
+        }
+
+        return size;
+    }
+
+    // NOTE: Passes everything through to the client's upstream, memorizing the
+    // response chunks, and caches them once the response is complete.
+    struct recorder_t:
+        public api::stream_t
+    {
+        recorder_t(response_cache_t& cache,
+                   const std::string& key,
+                   const boost::shared_ptr<api::stream_t>& upstream):
+            m_cache(cache),
+            m_key(key),
+            m_upstream(upstream),
+            m_size(key.size()),
+            m_overflow(false)
+        { }
+
+        virtual
+        void
+        push(const char * chunk,
+             size_t size)
+        {
+            m_upstream->push(chunk, size);
+
+            if(m_overflow) {
+                return;
+            }
+
+            m_size += size;
+
+            if(m_size > m_cache.limit()) {
+                // The response is too large to be cached.
+                m_overflow = true;
+                m_response.clear();
+                return;
+            }
+
+            m_response.emplace_back(chunk, size);
+        }
+
+        virtual
+        void
+        error(error_code code,
+              const std::string& message)
+        {
+            m_overflow = true;
+            m_upstream->error(code, message);
+        }
+
+        virtual
+        void
+        close() {
+            m_upstream->close();
+
+            if(!m_overflow) {
+                m_cache.insert(m_key, m_response);
+            }
+        }
+
+        virtual
+        bool
+        writable() {
+            return m_upstream->writable();
+        }
+
+        virtual
+        void
+        notify(const boost::function<void()>& callback) {
+            m_upstream->notify(callback);
+        }
+
+    private:
+        response_cache_t& m_cache;
+
+        const std::string m_key;
+        const boost::shared_ptr<api::stream_t> m_upstream;
+
+        response_cache_t::chunk_list_t m_response;
+        size_t m_size;
+        bool m_overflow;
+    };
+}
+
+response_cache_t::response_cache_t(const Json::Value& args):
+    m_ttl(args.get("ttl", 60.0f).asDouble()),
+    m_budget(args.get("budget", 64 * 1024 * 1024).asUInt()),
+    m_size(0),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0)
+{
+    const Json::Value events(args["events"]);
+
+    if(!events.isNull() && !events.isArray()) {
+        throw configuration_error_t("cached events must be specified as an array");
+    }
+
+    for(Json::Value::const_iterator it = events.begin(); it != events.end(); ++it) {
+        m_events.insert((*it).asString());
+    }
+
+    if(m_ttl <= 0.0f) {
+        throw configuration_error_t("response cache ttl must be positive");
+    }
+
+    if(m_budget == 0) {
+        throw configuration_error_t("response cache budget must be positive");
+    }
+}
+
+bool
+response_cache_t::eligible(const api::event_t& event) const {
+    return m_events.find(event.type) != m_events.end();
+}
+
+bool
+response_cache_t::lookup(const std::string& key,
+                         chunk_list_t& response)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    entry_map_t::iterator it(m_entries.find(key));
+
+    if(it == m_entries.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    if(it->second.expires_at <= now()) {
+        m_size -= it->second.size;
+        m_lru.erase(it->second.position);
+        m_entries.erase(it);
+
+        ++m_misses;
+
+        return false;
+    }
+
+    // Move the entry to the front of the recency list.
+    m_lru.splice(m_lru.begin(), m_lru, it->second.position);
+
+    response = it->second.response;
+
+    ++m_hits;
+
+    return true;
+}
+
+void
+response_cache_t::insert(const std::string& key,
+                         const chunk_list_t& response)
+{
+    const size_t size = measure(key, response);
+
+    if(size > limit()) {
+        return;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    entry_map_t::iterator it(m_entries.find(key));
+
+    if(it != m_entries.end()) {
+        m_size -= it->second.size;
+        m_lru.erase(it->second.position);
+        m_entries.erase(it);
+    }
+
+    m_lru.push_front(key);
+
+    entry_t& entry = m_entries[key];
+
+    entry.response = response;
+    entry.expires_at = now() + m_ttl;
+    entry.size = size;
+    entry.position = m_lru.begin();
+
+    m_size += size;
+
+    evict();
+}
+
+boost::shared_ptr<api::stream_t>
+response_cache_t::record(const std::string& key,
+                         const boost::shared_ptr<api::stream_t>& upstream)
+{
+    return boost::make_shared<recorder_t>(boost::ref(*this), key, upstream);
+}
+
+Json::Value
+response_cache_t::info() {
+    Json::Value info(Json::objectValue);
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        info["entries"] = static_cast<Json::LargestUInt>(m_entries.size());
+        info["size"] = static_cast<Json::LargestUInt>(m_size);
+    }
+
+    const uint64_t hits = m_hits,
+                   misses = m_misses;
+
+    info["hits"] = static_cast<Json::LargestUInt>(hits);
+    info["misses"] = static_cast<Json::LargestUInt>(misses);
+    info["hit-ratio"] = hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0f;
+    info["evictions"] = static_cast<Json::LargestUInt>(m_evictions.load());
+
+    return info;
+}
+
+void
+response_cache_t::evict() {
+    while(m_size > m_budget && !m_lru.empty()) {
+        entry_map_t::iterator it(m_entries.find(m_lru.back()));
+
+        m_size -= it->second.size;
+        m_entries.erase(it);
+        m_lru.pop_back();
+
+        ++m_evictions;
+    }
+}
@@ -24,6 +24,7 @@
 #include "cocaine/context.hpp"
 #include "cocaine/format.hpp"
 #include "cocaine/logging.hpp"
+#include "cocaine/pressure.hpp"
 
 #include "cocaine/api/service.hpp"
 
@@ -55,6 +56,11 @@ namespace {
 
             m_sigquit.set<runtime_t, &runtime_t::on_terminate>(this);
             m_sigquit.start(SIGQUIT);
+
+            if(m_context.config.pressure.interval > 0.0f) {
+                m_pressure_timer.set<runtime_t, &runtime_t::on_pressure>(this);
+                m_pressure_timer.start(0.0f, m_context.config.pressure.interval);
+            }
            
             COCAINE_LOG_INFO(
                 m_log,
@@ -110,6 +116,23 @@ namespace {
             m_loop.unloop(ev::ALL);
         }
 
+        void
+        on_pressure(ev::timer&, int) {
+            pressure_monitor_t& monitor = m_context.pressure();
+
+            const pressure_monitor_t::level_t level = monitor.level();
+
+            monitor.sample();
+
+            if(monitor.level() != level) {
+                COCAINE_LOG_WARNING(
+                    m_log,
+                    "the host pressure level has changed: %s",
+                    monitor.info()["level"].asString()
+                );
+            }
+        }
+
     private:
         context_t& m_context;
         std::unique_ptr<log_t> m_log;
@@ -122,6 +145,9 @@ namespace {
         ev::sig m_sigterm;
         ev::sig m_sigquit; 
 
+        // Host pressure sampling.
+        ev::timer m_pressure_timer;
+
         typedef std::vector<
             std::pair<std::string, std::unique_ptr<api::service_t>>
         > service_list_t;
@@ -20,34 +20,111 @@
 
 #include "cocaine/session.hpp"
 
+#include "cocaine/histogram.hpp"
+
 using namespace cocaine::engine;
 
 session_t::session_t(uint64_t id_,
                      const api::event_t& event_,
-                     const boost::shared_ptr<api::stream_t>& upstream_):
+                     const boost::shared_ptr<api::stream_t>& upstream_,
+                     unsigned long window,
+                     const boost::shared_ptr<spool_t>& spool):
     id(id_),
     event(event_),
     upstream(upstream_),
-    m_slave(NULL)
+    birthstamp(latency_t::now()),
+    m_spool(spool),
+    m_cached(0),
+    m_complete(false),
+    m_window(window),
+    m_throttled(window > 0),
+    m_credits(window),
+    m_delivered(0),
+    m_withheld(0),
+    m_cancelled(false),
+    m_dispatched(0),
+    m_responded(false),
+    m_slave(NULL),
+    m_tag(0)
 { }
 
+session_t::~session_t() {
+    drop();
+
+    for(size_t i = 0; i < held(); ++i) {
+        if(m_spool) {
+            m_spool->dequeue((*m_backlog)[i].second.size());
+        }
+    }
+}
+
+namespace {
+    struct forward_t {
+        void
+        operator()(int type,
+                   const char * data,
+                   size_t size) const
+        {
+            slave->send(type, session_t::rebind(data, size, tag));
+        }
+
+        slave_t * slave;
+        uint64_t tag;
+    };
+
+    struct collect_t {
+        void
+        operator()(int type,
+                   const char * data,
+                   size_t size) const
+        {
+            frames->emplace_back(type, std::string(data, size));
+        }
+
+        session_t::message_cache_t * frames;
+    };
+}
+
 void
-session_t::attach(slave_t * const slave) {
+session_t::attach(slave_t * const slave,
+                  uint64_t tag,
+                  bool flush)
+{
     BOOST_ASSERT(!m_slave);
     
     boost::unique_lock<boost::mutex> lock(m_mutex);
 
     m_slave = slave;
+    m_tag = tag;
 
-    if(!m_cache.empty()) {
+    if(flush && !m_cache.empty()) {
         for(message_cache_t::const_iterator it = m_cache.begin();
             it != m_cache.end();
             ++it)
         {
-            m_slave->send(it->first, it->second);
+            m_slave->send(it->first, rebind(it->second, m_tag));
         }
 
-        m_cache.clear();
+        if(m_spill) {
+            const forward_t forward = { m_slave, m_tag };
+            m_spill->visit(forward);
+        }
+    }
+
+    drop();
+
+    // NOTE: The cached chunks have already been accounted for, so for the slaves
+    // which support flow control the remaining credits are kept as they are.
+    if(m_throttled && !m_slave->supports(slave_t::features::credits)) {
+        m_throttled = false;
+    }
+
+    std::vector<boost::function<void()>> waiters(release());
+
+    lock.unlock();
+
+    for(size_t i = 0; i < waiters.size(); ++i) {
+        waiters[i]();
     }
 }
 
@@ -60,4 +137,226 @@ session_t::detach() {
     // NOTE: In case the client managed to get the shared_ptr to the
     // session the same moment when it got erased in the slave's session map.
     m_slave = NULL;
+
+    // NOTE: The session is over, so whatever has been held back is dropped, and
+    // the waiting client, if any, is released as there's no one to grant credits.
+    for(size_t i = 0; i < held(); ++i) {
+        if(m_spool) {
+            m_spool->dequeue((*m_backlog)[i].second.size());
+        }
+    }
+
+    m_backlog.reset();
+    m_throttled = false;
+
+    std::vector<boost::function<void()>> waiters;
+
+    waiters.swap(m_waiters);
+
+    lock.unlock();
+
+    for(size_t i = 0; i < waiters.size(); ++i) {
+        waiters[i]();
+    }
+}
+
+session_t::message_cache_t
+session_t::cache() {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    message_cache_t result(m_cache);
+
+    if(m_spill) {
+        const collect_t collect = { &result };
+        m_spill->visit(collect);
+    }
+
+    return result;
+}
+
+void
+session_t::store(int type,
+                 const char * data,
+                 size_t size)
+{
+    if(!m_spill && (!m_spool || m_spool->reserve(size))) {
+        m_cache.emplace_back(type, std::string(data, size));
+        m_cached += size;
+    } else {
+        if(!m_spill) {
+            m_spill.reset(new spill_t(*m_spool));
+        }
+
+        m_spill->append(type, data, size);
+    }
+
+    if(m_spool) {
+        m_spool->enqueue(size);
+    }
+}
+
+void
+session_t::drop() {
+    if(m_spool) {
+        m_spool->release(m_cached);
+        m_spool->dequeue(m_cached + (m_spill ? m_spill->size() : 0));
+    }
+
+    m_cache.clear();
+    m_cached = 0;
+    m_spill.reset();
+}
+
+std::string
+session_t::rebind(const std::string& frame,
+                  uint64_t tag)
+{
+    return rebind(frame.data(), frame.size(), tag);
+}
+
+std::string
+session_t::rebind(const char * data,
+                  size_t size,
+                  uint64_t tag)
+{
+    msgpack::unpacked unpacked;
+
+    msgpack::unpack(&unpacked, data, size);
+
+    const msgpack::object& object = unpacked.get();
+
+    BOOST_ASSERT(object.type == msgpack::type::ARRAY && object.via.array.size);
+
+    msgpack::sbuffer buffer;
+    msgpack::packer<msgpack::sbuffer> packer(buffer);
+
+    packer.pack_array(object.via.array.size);
+    packer << tag;
+
+    for(size_t i = 1; i < object.via.array.size; ++i) {
+        packer << object.via.array.ptr[i];
+    }
+
+    return std::string(buffer.data(), buffer.size());
+}
+
+bool
+session_t::complete() {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return !m_slave && m_complete;
+}
+
+bool
+session_t::cached() {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return !m_slave && m_complete && !m_spill;
+}
+
+void
+session_t::grant(uint64_t credits) {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    m_credits += credits;
+
+    std::vector<boost::function<void()>> waiters(release());
+
+    lock.unlock();
+
+    for(size_t i = 0; i < waiters.size(); ++i) {
+        waiters[i]();
+    }
+}
+
+bool
+session_t::writable() {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return !m_throttled || (m_credits && !held());
+}
+
+void
+session_t::notify(const boost::function<void()>& callback) {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    if(m_throttled && (!m_credits || held())) {
+        m_waiters.push_back(callback);
+        return;
+    }
+
+    lock.unlock();
+
+    callback();
+}
+
+void
+session_t::defer(int type,
+                 const char * data,
+                 size_t size)
+{
+    if(!m_backlog) {
+        m_backlog.reset(new std::deque<std::pair<int, std::string>>());
+    }
+
+    m_backlog->emplace_back(type, std::string(data, size));
+
+    if(m_spool) {
+        m_spool->enqueue(size);
+    }
+}
+
+std::vector<boost::function<void()>>
+session_t::release() {
+    while(held()) {
+        const std::pair<int, std::string>& frame = m_backlog->front();
+
+        if(m_throttled && frame.first == io::event_traits<io::rpc::chunk>::id) {
+            if(!m_credits) {
+                break;
+            }
+
+            --m_credits;
+        }
+
+        if(m_spool) {
+            m_spool->dequeue(frame.second.size());
+        }
+
+        if(m_slave) {
+            m_slave->send(frame.first, rebind(frame.second, m_tag));
+        } else {
+            store(frame.first, frame.second.data(), frame.second.size());
+
+            if(frame.first == io::event_traits<io::rpc::choke>::id) {
+                m_complete = true;
+            }
+        }
+
+        m_backlog->pop_front();
+    }
+
+    std::vector<boost::function<void()>> waiters;
+
+    if(!m_throttled || (m_credits && !held())) {
+        waiters.swap(m_waiters);
+    }
+
+    return waiters;
+}
+
+uint64_t
+session_t::consume() {
+    if(!m_window) {
+        return 0;
+    }
+
+    // NOTE: Grant the credits back in halves of the window, so that the
+    // slave wouldn't stall while not flooding the bus with grants either.
+    if(++m_delivered < std::max(1UL, m_window / 2)) {
+        return 0;
+    }
+
+    uint64_t credits = m_delivered;
+
+    m_delivered = 0;
+
+    return credits;
 }
@@ -0,0 +1,198 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/shm.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+const uint64_t ring_t::magic;
+const size_t shm_t::threshold;
+
+ring_t::ring_t(void * base,
+               size_t capacity):
+    m_header(new(base) header_t()),
+    m_data(static_cast<char*>(base) + sizeof(header_t)),
+    m_capacity(capacity)
+{
+    m_header->capacity = capacity;
+    m_header->head = 0;
+    m_header->tail = 0;
+
+    // NOTE: The magic is written last, so that the peer wouldn't use a ring
+    // which hasn't been completely initialized yet.
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_header->magic = magic;
+}
+
+bool
+ring_t::write(const char * data,
+              size_t size)
+{
+    const uint64_t tail = m_header->tail.load(std::memory_order_relaxed),
+                   head = m_header->head.load(std::memory_order_acquire);
+
+    if(tail - head > m_capacity) {
+        throw cocaine::error_t("the shared memory ring is out of sync");
+    }
+
+    if(size > m_capacity - (tail - head)) {
+        return false;
+    }
+
+    const size_t offset = tail % m_capacity,
+                 first = std::min(size, m_capacity - offset);
+
+    std::memcpy(m_data + offset, data, first);
+    std::memcpy(m_data, data + first, size - first);
+
+    m_header->tail.store(tail + size, std::memory_order_release);
+
+    return true;
+}
+
+uint64_t
+ring_t::check(size_t size) const {
+    const uint64_t head = m_header->head.load(std::memory_order_relaxed),
+                   tail = m_header->tail.load(std::memory_order_acquire);
+
+    // NOTE: The positions are written by the peer, so they're not trusted. The
+    // announced size can't exceed the capacity with a sane tail position.
+    if(tail - head > m_capacity || size > tail - head) {
+        throw cocaine::error_t("the shared memory ring is out of sync");
+    }
+
+    return head;
+}
+
+const char*
+ring_t::front(size_t size) const {
+    // NOTE: The head is only read once, so that the peer couldn't move it
+    // after it has been validated.
+    const uint64_t head = check(size);
+
+    const size_t offset = head % m_capacity;
+
+    return offset + size <= m_capacity ? m_data + offset : NULL;
+}
+
+void
+ring_t::read(char * buffer,
+             size_t size) const
+{
+    const uint64_t head = check(size);
+
+    const size_t offset = head % m_capacity,
+                 first = std::min(size, m_capacity - offset);
+
+    std::memcpy(buffer, m_data + offset, first);
+    std::memcpy(buffer + first, m_data, size - first);
+}
+
+void
+ring_t::consume(size_t size) {
+    m_header->head.fetch_add(size, std::memory_order_release);
+}
+
+namespace {
+    size_t
+    region(size_t capacity) {
+        // NOTE: Keep both ring headers aligned to the cache line.
+        return (sizeof(ring_t::header_t) + capacity + 63) & ~static_cast<size_t>(63);
+    }
+
+    int
+    create(const std::string& path,
+           size_t size)
+    {
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+        if(fd == -1) {
+            throw cocaine::error_t(
+                "unable to create the shared memory file '%s' - %s",
+                path,
+                ::strerror(errno)
+            );
+        }
+
+        if(::ftruncate(fd, size) != 0) {
+            const int error = errno;
+
+            ::close(fd);
+            ::unlink(path.c_str());
+
+            throw cocaine::error_t(
+                "unable to resize the shared memory file '%s' - %s",
+                path,
+                ::strerror(error)
+            );
+        }
+
+        return fd;
+    }
+
+    char*
+    map(const std::string& path,
+        int fd,
+        size_t size)
+    {
+        void * base = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if(base == MAP_FAILED) {
+            const int error = errno;
+
+            ::close(fd);
+            ::unlink(path.c_str());
+
+            throw cocaine::error_t(
+                "unable to map the shared memory file '%s' - %s",
+                path,
+                ::strerror(error)
+            );
+        }
+
+        return static_cast<char*>(base);
+    }
+}
+
+shm_t::shm_t(const std::string& path,
+             size_t capacity):
+    m_path(path),
+    m_size(region(capacity) * 2),
+    m_fd(create(m_path, m_size)),
+    m_base(map(m_path, m_fd, m_size)),
+    m_outbound(m_base, capacity),
+    m_inbound(m_base + region(capacity), capacity)
+{ }
+
+shm_t::~shm_t() {
+    ::munmap(m_base, m_size);
+    ::close(m_fd);
+    ::unlink(m_path.c_str());
+}
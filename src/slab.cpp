@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/slab.hpp"
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+slab_t::slab_t():
+    m_allocated(0),
+    m_recycled(0),
+    m_oversized(0)
+{
+    std::fill(m_free, m_free + classes, static_cast<block_t*>(NULL));
+    std::fill(m_cursor, m_cursor + classes, static_cast<char*>(NULL));
+    std::fill(m_limit, m_limit + classes, static_cast<char*>(NULL));
+}
+
+slab_t::~slab_t() {
+    for(std::vector<char*>::iterator it = m_chunks.begin();
+        it != m_chunks.end();
+        ++it)
+    {
+        delete[] *it;
+    }
+}
+
+size_t
+slab_t::index(size_t size) {
+    size_t result = 0;
+
+    while(result != classes && (minimum << result) < size) {
+        ++result;
+    }
+
+    return result;
+}
+
+void*
+slab_t::allocate(size_t size) {
+    const size_t cls = index(size);
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    ++m_allocated;
+
+    if(cls == classes) {
+        ++m_oversized;
+        lock.unlock();
+        return ::operator new(size);
+    }
+
+    if(m_free[cls] != NULL) {
+        block_t * block = m_free[cls];
+
+        m_free[cls] = block->next;
+        ++m_recycled;
+
+        return block;
+    }
+
+    const size_t block_size = minimum << cls;
+
+    if(m_cursor[cls] == m_limit[cls]) {
+        char * chunk = new char[chunk_size];
+
+        m_chunks.push_back(chunk);
+
+        // NOTE: The chunk size is a multiple of every block size.
+        m_cursor[cls] = chunk;
+        m_limit[cls] = chunk + chunk_size;
+    }
+
+    void * block = m_cursor[cls];
+
+    m_cursor[cls] += block_size;
+
+    return block;
+}
+
+void
+slab_t::deallocate(void * ptr,
+                   size_t size)
+{
+    const size_t cls = index(size);
+
+    if(cls == classes) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    block_t * block = static_cast<block_t*>(ptr);
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    block->next = m_free[cls];
+    m_free[cls] = block;
+}
+
+Json::Value
+slab_t::info() const {
+    Json::Value info(Json::objectValue);
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    info["chunks"] = static_cast<Json::LargestUInt>(m_chunks.size());
+    info["memory"] = static_cast<Json::LargestUInt>(m_chunks.size() * chunk_size);
+    info["allocated"] = static_cast<Json::LargestUInt>(m_allocated);
+    info["recycled"] = static_cast<Json::LargestUInt>(m_recycled);
+    info["oversized"] = static_cast<Json::LargestUInt>(m_oversized);
+
+    return info;
+}
@@ -33,46 +33,66 @@
 
 #include "cocaine/traits/unique_id.hpp" 
 
+#include <limits>
+#include <new>
+
 using namespace cocaine;
 using namespace cocaine::engine;
 using namespace cocaine::io;
 using namespace cocaine::logging;
 
 slave_t::slave_t(context_t& context,
-                 const manifest_t& manifest,
-                 const profile_t& profile,
+                 const boost::shared_ptr<const manifest_t>& manifest,
+                 const boost::shared_ptr<const profile_t>& profile,
+                 unsigned int generation,
+                 const std::string& path,
                  engine_t& engine):
     m_context(context),
-    m_log(new log_t(context, cocaine::format("app/%s", manifest.name))),
+    m_log(new log_t(context, cocaine::format("app/%s", manifest->name))),
     m_manifest(manifest),
     m_profile(profile),
     m_engine(engine),
+    m_generation(generation),
     m_state(state_t::unknown),
+    m_features(0),
+    m_failed(false),
+    m_processed(0),
+    m_retiring(false),
     m_heartbeat_timer(engine.loop()),
-    m_idle_timer(engine.loop())
+    m_idle_timer(engine.loop()),
+    m_load(0),
+    m_compression_threshold(0)
 {
+    // NOTE: The session table is sized for the profile concurrency upfront, but
+    // is still able to grow if the slave gets overcommitted by hedging.
+    grow(m_profile->concurrency);
+
     auto isolate = m_context.get<api::isolate_t>(
-        m_profile.isolate.type,
+        m_profile->isolate.type,
         m_context,
-        m_manifest.name,
-        m_profile.isolate.args
+        m_manifest->name,
+        m_profile->isolate.args
     );
 
     std::map<std::string, std::string> args,
                                        environment;
 
     args["-c"] = m_context.config.path.config;
-    args["--app"] = m_manifest.name;
-    args["--profile"] = m_profile.name;
+    args["--app"] = m_manifest->name;
+    args["--profile"] = m_profile->name;
     args["--uuid"] = m_id.string();
 
+    // NOTE: Each app version is deployed to its own directory, so that the
+    // slaves of different generations could run side by side.
+    args["--spool"] = path;
+
     COCAINE_LOG_DEBUG(m_log, "slave %s is activating", m_id);
 
-    m_handle = isolate->spawn(m_manifest.slave, args, environment);
+    m_handle = isolate->spawn(m_manifest->slave, args, environment);
 
     // NOTE: Initialization heartbeat can be different.
     m_heartbeat_timer.set<slave_t, &slave_t::on_timeout>(this);
-    m_heartbeat_timer.start(m_profile.startup_timeout);
+    m_heartbeat_timer.start(m_profile->startup_timeout);
 }
 
 slave_t::~slave_t() {    
@@ -81,10 +101,49 @@ slave_t::~slave_t() {
     }
 }
 
+uint64_t
+slave_t::acquire() {
+    BOOST_ASSERT(m_state == state_t::active);
+
+    if(m_free.empty()) {
+        grow(m_slots.size() + 1);
+    }
+
+    slot_t& slot = m_slots[m_free.back()];
+
+    m_free.pop_back();
+
+    // NOTE: Bump the slot generation in the upper half of the tag, keeping the
+    // slot index in the lower half.
+    slot.tag = (((slot.tag >> 32) + 1) << 32) | (slot.tag & 0xFFFFFFFF);
+
+    ++m_load;
+
+    return slot.tag;
+}
+
 void
-slave_t::assign(boost::shared_ptr<session_t>&& session) {
+slave_t::discard(uint64_t tag) {
+    const size_t index = tag & 0xFFFFFFFF;
+
+    BOOST_ASSERT(m_slots[index].tag == tag && !m_slots[index].session);
+
+    m_free.push_back(index);
+
+    --m_load;
+}
+
+void
+slave_t::assign(boost::shared_ptr<session_t>&& session,
+                uint64_t tag,
+                bool flush)
+{
     BOOST_ASSERT(m_state == state_t::active);
 
+    slot_t& slot = m_slots[tag & 0xFFFFFFFF];
+
+    BOOST_ASSERT(slot.tag == tag && !slot.session);
+
     COCAINE_LOG_DEBUG(
         m_log,
         "slave %s has started processing session %s",
@@ -92,9 +151,19 @@ slave_t::assign(boost::shared_ptr<session_t>&& session) {
         session->id
     );
 
-    session->attach(this);
+    session->attach(this, tag, flush);
+    session->dispatch(latency_t::now());
 
-    m_sessions.emplace(session->id, std::move(session));
+    ++m_processed;
+
+    // NOTE: The initial window for the slave's replies. The request direction
+    // is implicitly granted the same window, and the slave is expected to grant
+    // the credits back as it consumes the request chunks.
+    if(m_profile->session_window && supports(features::credits)) {
+        send<rpc::credit>(tag, m_profile->session_window);
+    }
+
+    slot.session = std::move(session);
 
     if(m_idle_timer.is_active()) {
         m_idle_timer.stop();
@@ -110,95 +179,566 @@ slave_t::on_ping() {
     send<rpc::heartbeat>();
 }
 
+namespace {
+    struct feature_t {
+        const char * name;
+        slave_t::features value;
+    };
+
+    static
+    const feature_t
+    known_features[] = {
+        { "batching", slave_t::features::batching },
+        { "credits", slave_t::features::credits },
+        { "cancellation", slave_t::features::cancellation },
+        { "shm", slave_t::features::shm },
+        { "fd", slave_t::features::fd },
+        { "lz4", slave_t::features::lz4 }
+    };
+}
+
 void
-slave_t::on_chunk(uint64_t session_id,
-                  const std::string& message)
+slave_t::on_handshake(const std::vector<std::string>& features) {
+    BOOST_ASSERT(m_state != state_t::dead);
+
+    int negotiated = 0;
+
+    for(std::vector<std::string>::const_iterator it = features.begin();
+        it != features.end();
+        ++it)
+    {
+        const feature_t * feature = std::begin(known_features);
+
+        while(feature != std::end(known_features) && *it != feature->name) {
+            ++feature;
+        }
+
+        if(feature == std::end(known_features)) {
+            COCAINE_LOG_DEBUG(
+                m_log,
+                "slave %s supports an unknown feature '%s', ignoring",
+                m_id,
+                *it
+            );
+
+            continue;
+        }
+
+        COCAINE_LOG_DEBUG(m_log, "slave %s supports '%s'", m_id, *it);
+
+        negotiated |= feature->value;
+    }
+
+    if(negotiated & features::lz4) {
+        if(compressor_t::available() && m_profile->compression_threshold) {
+            m_compression_threshold = m_profile->compression_threshold;
+        } else {
+            negotiated &= ~features::lz4;
+        }
+    }
+
+    if((negotiated & features::fd) && !m_fds) {
+        if(m_profile->fd_threshold) {
+            try {
+                m_fds.reset(new fd_channel_t(
+                    cocaine::format("%s/engines/%s.fd", m_context.config.path.runtime, m_id),
+                    m_profile->fd_threshold,
+                    m_engine.loop()
+                ));
+            } catch(const cocaine::error_t& e) {
+                COCAINE_LOG_WARNING(
+                    m_log,
+                    "slave %s will not pass chunks by descriptors - %s",
+                    m_id,
+                    e.what()
+                );
+
+                negotiated &= ~features::fd;
+            }
+        } else {
+            negotiated &= ~features::fd;
+        }
+    }
+
+    // NOTE: The rings are created once the handshake is received. The slave is
+    // expected to map them when the file shows up under the same name, and to
+    // keep sending the chunks through the bus until then. If the rings are
+    // disabled in the profile, the file is never created.
+    if((negotiated & features::shm) && !m_shm) {
+        if(m_profile->shm_ring) {
+            try {
+                m_shm.reset(new shm_t(
+                    cocaine::format("%s/engines/%s.shm", m_context.config.path.runtime, m_id),
+                    m_profile->shm_ring
+                ));
+            } catch(const cocaine::error_t& e) {
+                COCAINE_LOG_WARNING(
+                    m_log,
+                    "slave %s will exchange chunks through the bus only - %s",
+                    m_id,
+                    e.what()
+                );
+
+                negotiated &= ~features::shm;
+            }
+        } else {
+            negotiated &= ~features::shm;
+        }
+    }
+
+    // NOTE: The features are read by the driver threads sending the chunks, so
+    // they're only published once the transports they refer to are set up.
+    m_features.store(negotiated, std::memory_order_release);
+}
+
+void
+slave_t::on_handlers(const std::vector<std::string>& events) {
+    BOOST_ASSERT(m_state != state_t::dead);
+
+    m_handlers.clear();
+
+    // NOTE: The handler indices are only an optimization, so a slave announcing
+    // too many of them is simply invoked by name.
+    if(events.size() > defaults::symbol_quota) {
+        COCAINE_LOG_WARNING(
+            m_log,
+            "slave %s has announced %llu handlers, which is more than %llu - ignoring",
+            m_id,
+            events.size(),
+            defaults::symbol_quota
+        );
+
+        return;
+    }
+
+    for(size_t index = 0; index < events.size(); ++index) {
+        const symbol_t event(m_engine.intern(events[index]));
+
+        if(!event.interned()) {
+            COCAINE_LOG_DEBUG(
+                m_log,
+                "slave %s handler '%s' will be invoked by name, no symbols left for the app",
+                m_id,
+                event
+            );
+
+            continue;
+        }
+
+        if(m_handlers.size() <= event.id()) {
+            m_handlers.resize(event.id() + 1, 0);
+        }
+
+        m_handlers[event.id()] = index + 1;
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "slave %s has announced %llu handlers", m_id, events.size());
+}
+
+bool
+slave_t::handler(const symbol_t& event,
+                 uint32_t& index) const
+{
+    if(!event.interned() ||
+       event.id() >= m_handlers.size() ||
+       !m_handlers[event.id()])
+    {
+        return false;
+    }
+
+    index = m_handlers[event.id()] - 1;
+
+    return true;
+}
+
+slave_t::slot_t*
+slave_t::find(uint64_t tag) {
+    const size_t index = tag & 0xFFFFFFFF;
+
+    // NOTE: The tag check drops the messages for the sessions which have already
+    // been completed or cancelled, even if their slot has been reused since.
+    if(index >= m_slots.size() ||
+       m_slots[index].tag != tag ||
+       !m_slots[index].session)
+    {
+        return NULL;
+    }
+
+    return &m_slots[index];
+}
+
+void
+slave_t::erase(slot_t& slot) {
+    BOOST_ASSERT(slot.session && m_load);
+
+    slot.session.reset();
+
+    m_free.push_back(slot.tag & 0xFFFFFFFF);
+
+    if(--m_load == 0) {
+        release();
+    }
+}
+
+void
+slave_t::grow(size_t size) {
+    const size_t current = m_slots.size();
+
+    m_slots.resize(std::max(current, size));
+
+    // NOTE: The free slots are taken from the back, so the lower slots are reused
+    // first, keeping the working set of the table small.
+    for(size_t index = current; index < m_slots.size(); ++index) {
+        m_slots[index].tag = index;
+        m_free.insert(m_free.begin(), index);
+    }
+}
+
+void
+slave_t::on_chunk_ref(uint64_t tag,
+                      uint64_t size)
+{
+    BOOST_ASSERT(m_state == state_t::active);
+
+    if(!m_shm) {
+        throw cocaine::error_t("the slave has no shared memory rings");
+    }
+
+    ring_t& ring = m_shm->inbound();
+
+    // NOTE: The chunk is delivered straight from the ring, unless it's wrapped
+    // around the ring boundary. Either way, it's consumed afterwards, so that
+    // the slave wouldn't overwrite it while it's being delivered.
+    const char * data = ring.front(size);
+
+    if(data) {
+        on_chunk(tag, data, size);
+    } else {
+        // NOTE: The size has been checked against the ring capacity by now.
+        std::vector<char> buffer;
+
+        try {
+            buffer.resize(size);
+        } catch(const std::bad_alloc& e) {
+            throw cocaine::error_t("unable to copy a %llu byte chunk from the ring", size);
+        }
+
+        ring.read(&buffer[0], size);
+
+        on_chunk(tag, &buffer[0], size);
+    }
+
+    ring.consume(size);
+}
+
+void
+slave_t::on_chunk_fd(uint64_t tag,
+                     uint64_t size)
+{
+    BOOST_ASSERT(m_state == state_t::active);
+
+    if(!m_fds) {
+        throw cocaine::error_t("the slave has no descriptor channel");
+    }
+
+    int fd;
+
+    {
+        boost::unique_lock<fd_channel_t> lock(*m_fds);
+        fd = m_fds->recv();
+    }
+
+    const memfd_t body(fd, size);
+
+    on_chunk(tag, body.data(), body.size());
+}
+
+void
+slave_t::on_chunk_lz4(uint64_t tag,
+                      uint64_t original,
+                      const std::string& data)
+{
+    BOOST_ASSERT(m_state == state_t::active);
+
+    std::string chunk;
+
+    m_engine.compressor().decompress(data.data(), data.size(), original, chunk);
+
+    on_chunk(tag, chunk.data(), chunk.size());
+}
+
+void
+slave_t::on_chunk(uint64_t tag,
+                  const char * data,
+                  size_t size)
 {
     BOOST_ASSERT(m_state == state_t::active);
     
+    slot_t * slot = find(tag);
+
+    // NOTE: The session might have been cancelled while the chunk was in flight.
+    if(!slot) {
+        return;
+    }
+
     COCAINE_LOG_DEBUG(
         m_log,
         "slave %s received session %s chunk, size: %llu bytes",
         m_id,
-        session_id,
-        message.size()
+        slot->session->id,
+        size
     );
 
-    session_map_t::iterator it(m_sessions.find(session_id));
+    if(slot->session->respond()) {
+        m_engine.latency().record(
+            slot->session->event.type,
+            latency_t::response,
+            latency_t::now() - slot->session->dispatched()
+        );
+    }
+
+    if(!slot->session->cancelled()) {
+        try {
+            slot->session->upstream->push(data, size);
+        } catch(const std::exception& e) {
+            COCAINE_LOG_WARNING(
+                m_log,
+                "slave %s is unable to deliver session %s chunk, cancelling - %s",
+                m_id,
+                slot->session->id,
+                e.what()
+            );
+
+            cancel(*slot);
+
+            return;
+        }
+    }
+
+    if(!supports(features::credits)) {
+        return;
+    }
 
-    // TEST: Ensure that this slave is responsible for the session.
-    BOOST_ASSERT(it != m_sessions.end());
+    const uint64_t credits = slot->session->consume();
 
-    it->second->upstream->push(message.data(), message.size());
+    if(!credits) {
+        return;
+    }
+
+    // NOTE: The credits are only granted back once the client has actually
+    // drained its upstream, otherwise a slow client would never throttle the
+    // slave and the chunks would pile up in the client's buffers instead.
+    if(slot->session->cancelled() || slot->session->upstream->writable()) {
+        send<rpc::credit>(tag, credits + slot->session->restore());
+    } else {
+        m_engine.withhold(slot->session, credits);
+    }
 }
 
 void
-slave_t::on_error(uint64_t session_id,
+slave_t::on_error(uint64_t tag,
                   error_code code,
                   const std::string& message)
 {
     BOOST_ASSERT(m_state == state_t::active);
     
+    slot_t * slot = find(tag);
+
+    if(!slot || slot->session->cancelled()) {
+        return;
+    }
+
     COCAINE_LOG_DEBUG(
         m_log,
         "slave %s received session %s error, code: %d, message: %s",
         m_id,
-        session_id,
+        slot->session->id,
         code,
         message
     );
 
-    session_map_t::iterator it(m_sessions.find(session_id));
-
-    // TEST: Ensure that this slave is responsible for the session.
-    BOOST_ASSERT(it != m_sessions.end());
+    try {
+        slot->session->upstream->error(code, message);
+    } catch(const std::exception& e) {
+        COCAINE_LOG_WARNING(
+            m_log,
+            "slave %s is unable to deliver session %s error, cancelling - %s",
+            m_id,
+            slot->session->id,
+            e.what()
+        );
 
-    it->second->upstream->error(code, message);
+        cancel(*slot);
+    }
 }
 
 void
-slave_t::on_choke(uint64_t session_id) {
+slave_t::on_choke(uint64_t tag) {
     BOOST_ASSERT(m_state == state_t::active);
     
+    slot_t * slot = find(tag);
+
+    if(!slot) {
+        return;
+    }
+
     COCAINE_LOG_DEBUG(
         m_log,
         "slave %s has completed session %s",
         m_id,
-        session_id
+        slot->session->id
     );
 
-    session_map_t::iterator it(m_sessions.find(session_id));
-
-    // TEST: Ensure that this slave is responsible for the session.
-    BOOST_ASSERT(it != m_sessions.end());
+    m_engine.latency().record(
+        slot->session->event.type,
+        latency_t::completion,
+        latency_t::now() - slot->session->dispatched()
+    );
 
-    it->second->upstream->close();
+    if(!slot->session->cancelled()) {
+        try {
+            slot->session->upstream->close();
+        } catch(const std::exception& e) {
+            COCAINE_LOG_WARNING(
+                m_log,
+                "slave %s is unable to close session %s upstream - %s",
+                m_id,
+                slot->session->id,
+                e.what()
+            );
+        }
+    }
 
     // NOTE: As we're destroying the session here, we have to close the
     // downstream, otherwise the client wouldn't be able to close it later.
-    it->second->send<rpc::choke>();
-    it->second->detach();
+    slot->session->send<rpc::choke>();
+    slot->session->detach();
+
+    erase(*slot);
+}
+
+void
+slave_t::on_credit(uint64_t tag,
+                   uint64_t credits)
+{
+    BOOST_ASSERT(m_state == state_t::active);
+
+    slot_t * slot = find(tag);
+
+    // NOTE: The grant might be racing with the session completion.
+    if(!slot) {
+        return;
+    }
+
+    slot->session->grant(credits);
+}
+
+bool
+slave_t::cancel(const boost::shared_ptr<session_t>& session) {
+    BOOST_ASSERT(m_state == state_t::active);
+
+    slot_t * slot = find(session->tag());
+
+    // NOTE: The tag is only meaningful for the slave the session is attached to,
+    // so the slot has to be checked to actually hold this very session.
+    if(!slot || slot->session != session) {
+        return false;
+    }
+
+    cancel(*slot);
+
+    return true;
+}
+
+bool
+slave_t::resume(const boost::shared_ptr<session_t>& session) {
+    BOOST_ASSERT(m_state == state_t::active);
+
+    slot_t * slot = find(session->tag());
+
+    if(!slot || slot->session != session) {
+        return false;
+    }
+
+    const uint64_t credits = session->restore();
+
+    if(credits) {
+        send<rpc::credit>(slot->tag, credits);
+    }
+
+    return true;
+}
 
-    m_sessions.erase(it);
+void
+slave_t::cancel(slot_t& slot) {
+    slot.session->cancel();
 
-    if(m_sessions.empty()) {
-        m_idle_timer.start(m_profile.idle_timeout);
+    if(!supports(features::cancellation)) {
+        COCAINE_LOG_DEBUG(
+            m_log,
+            "slave %s doesn't support cancellation, discarding session %s results",
+            m_id,
+            slot.session->id
+        );
+
+        // NOTE: The slave will keep processing the session anyway, so it has
+        // to keep occupying the slot until the slave is done with it.
+        return;
     }
+
+    COCAINE_LOG_DEBUG(m_log, "slave %s is cancelling session %s", m_id, slot.session->id);
+
+    send<rpc::cancel>(slot.tag);
+
+    // NOTE: The slot is freed immediately, any late messages for this session
+    // are silently dropped by the handlers.
+    slot.session->detach();
+
+    erase(slot);
 }
 
 namespace {
-    struct timeout_t {
+    struct failure_t {
+        failure_t(error_code code_,
+                  const std::string& reason_):
+            code(code_),
+            reason(reason_)
+        { }
+
         template<class T>
         void
-        operator()(T& session) const {
-            session.second->upstream->error(
-                timeout_error, 
-                "the session has timed out"
-            );
+        operator()(T& slot) const {
+            if(!slot.session) {
+                return;
+            }
+
+            slot.session->upstream->error(code, reason);
+
+            slot.session->detach();
+            slot.session.reset();
         }
+
+        const error_code code;
+        const std::string& reason;
     };
 }
 
+void
+slave_t::abort(error_code code,
+               const std::string& reason)
+{
+    std::for_each(m_slots.begin(), m_slots.end(), failure_t(code, reason));
+
+    // NOTE: The slot generations are kept, as the slave is going away anyway,
+    // only the free list has to be rebuilt.
+    m_free.clear();
+    m_load = 0;
+
+    for(size_t index = m_slots.size(); index > 0; --index) {
+        m_free.push_back(index - 1);
+    }
+}
+
 void
 slave_t::on_timeout(ev::timer&, int) {
     BOOST_ASSERT(m_state != state_t::dead);
@@ -213,12 +753,10 @@ slave_t::on_timeout(ev::timer&, int) {
                 m_log,
                 "slave %s has timed out, dropping %llu sessions",
                 m_id,
-                m_sessions.size()
+                m_load
             );
 
-            std::for_each(m_sessions.begin(), m_sessions.end(), timeout_t());
-
-            m_sessions.clear();
+            abort(timeout_error, "the session has timed out");
 
             break;
 
@@ -234,12 +772,87 @@ slave_t::on_timeout(ev::timer&, int) {
     terminate();
 }
 
+void
+slave_t::reconfigure(const boost::shared_ptr<const profile_t>& profile) {
+    BOOST_ASSERT(m_state != state_t::dead);
+
+    m_profile = profile;
+
+    grow(m_profile->concurrency);
+
+    // NOTE: The compression can't be enabled for the slave after the handshake,
+    // as it has been already negotiated, but it can be disabled.
+    if(supports(features::lz4)) {
+        m_compression_threshold = m_profile->compression_threshold ?
+            m_profile->compression_threshold :
+            std::numeric_limits<size_t>::max();
+    }
+
+    // NOTE: The startup timeout is left as is for the slaves which are still
+    // activating, as is the termination timeout for the inactive ones.
+    if(m_state != state_t::active) {
+        return;
+    }
+
+    m_heartbeat_timer.stop();
+    m_heartbeat_timer.start(m_profile->heartbeat_timeout);
+
+    if(m_idle_timer.is_active()) {
+        m_idle_timer.stop();
+        m_idle_timer.start(m_profile->idle_timeout);
+    }
+}
+
+void
+slave_t::retire() {
+    BOOST_ASSERT(m_state == state_t::active);
+
+    m_retiring = true;
+
+    if(m_load == 0) {
+        release();
+    } else {
+        COCAINE_LOG_DEBUG(
+            m_log,
+            "slave %s is retiring, draining %llu sessions",
+            m_id,
+            m_load
+        );
+    }
+}
+
+size_t
+slave_t::resident() const {
+    return m_handle ? m_handle->resident() : 0;
+}
+
 void
 slave_t::on_idle(ev::timer&, int) {
     BOOST_ASSERT(m_state == state_t::active);
     
     COCAINE_LOG_DEBUG(m_log, "slave %s is idle, deactivating", m_id);
 
+    deactivate();
+}
+
+void
+slave_t::release() {
+    if(!m_retiring) {
+        m_idle_timer.start(m_profile->idle_timeout);
+        return;
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "slave %s has been drained, deactivating", m_id);
+
+    deactivate();
+}
+
+void
+slave_t::deactivate() {
+    if(m_idle_timer.is_active()) {
+        m_idle_timer.stop();
+    }
+
     send<rpc::terminate>();
 
     m_state = state_t::inactive;
@@ -252,7 +865,7 @@ slave_t::rearm() {
             m_log,
             "slave %s became active in %.03f seconds",
             m_id,
-            m_profile.startup_timeout - ev_timer_remaining(
+            m_profile->startup_timeout - ev_timer_remaining(
                 m_engine.loop(),
                 static_cast<ev_timer*>(&m_heartbeat_timer)
             )
@@ -260,20 +873,24 @@ slave_t::rearm() {
 
         m_state = state_t::active;
 
+        // NOTE: The node-wide spawn budget slot has been acquired by the engine
+        // before spawning this slave.
+        m_context.spawns().release();
+
         // Start the idle timer, which will kill the slave when it's not used.
         m_idle_timer.set<slave_t, &slave_t::on_idle>(this);
-        m_idle_timer.start(m_profile.idle_timeout);
+        m_idle_timer.start(m_profile->idle_timeout);
     }
 
     COCAINE_LOG_DEBUG(
         m_log,
         "slave %s resetting heartbeat timeout to %.02f seconds",
         m_id,
-        m_profile.heartbeat_timeout
+        m_profile->heartbeat_timeout
     );
 
     m_heartbeat_timer.stop();
-    m_heartbeat_timer.start(m_profile.heartbeat_timeout);
+    m_heartbeat_timer.start(m_profile->heartbeat_timeout);
 }
 
 void
@@ -284,11 +901,16 @@ slave_t::terminate() {
     BOOST_ASSERT(m_state != state_t::dead);
 
     // Ensure that no sessions are being lost here.
-    BOOST_ASSERT(m_sessions.empty());
+    BOOST_ASSERT(m_load == 0);
 
     m_heartbeat_timer.stop();
     m_idle_timer.stop();
 
+    if(m_state == state_t::unknown) {
+        m_context.spawns().release();
+        m_failed = true;
+    }
+
     m_handle->terminate();
     m_handle.reset();
 
@@ -0,0 +1,227 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/spool.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+spool_t::spool_t(const std::string& path,
+                 size_t budget):
+    m_path(path),
+    m_budget(budget),
+    m_memory(0),
+    m_pending(0),
+    m_files(0),
+    m_spilled(0)
+{ }
+
+bool
+spool_t::reserve(size_t size) {
+    size_t current = m_memory;
+
+    do {
+        if(current + size > m_budget) {
+            return false;
+        }
+    } while(!m_memory.compare_exchange_weak(current, current + size));
+
+    return true;
+}
+
+void
+spool_t::release(size_t size) {
+    m_memory -= size;
+}
+
+void
+spool_t::enqueue(size_t size) {
+    m_pending += size;
+}
+
+void
+spool_t::dequeue(size_t size) {
+    m_pending -= size;
+}
+
+int
+spool_t::open() {
+    std::vector<char> name(m_path.begin(), m_path.end());
+
+    const char suffix[] = "/spill-XXXXXX";
+
+    name.insert(name.end(), suffix, suffix + sizeof(suffix));
+
+    const int fd = ::mkstemp(&name[0]);
+
+    if(fd == -1) {
+        throw cocaine::error_t(
+            "unable to create a spill file in '%s' - %s",
+            m_path,
+            ::strerror(errno)
+        );
+    }
+
+    // NOTE: The file is only reachable through the descriptor, so that it's
+    // cleaned up automatically, even if the process crashes.
+    ::unlink(&name[0]);
+
+    ++m_files;
+
+    return fd;
+}
+
+Json::Value
+spool_t::info() const {
+    Json::Value info(Json::objectValue);
+
+    info["budget"] = static_cast<Json::LargestUInt>(m_budget);
+    info["memory"] = static_cast<Json::LargestUInt>(m_memory);
+    info["pending"] = static_cast<Json::LargestUInt>(m_pending);
+    info["files"] = static_cast<Json::LargestUInt>(m_files);
+    info["spilled"] = static_cast<Json::LargestUInt>(m_spilled);
+
+    return info;
+}
+
+spill_t::spill_t(spool_t& spool):
+    m_spool(spool),
+    m_fd(spool.open()),
+    m_size(0),
+    m_payload(0)
+{ }
+
+spill_t::~spill_t() {
+    ::close(m_fd);
+}
+
+void
+spill_t::append(int type,
+                const char * data,
+                size_t size)
+{
+    header_t header = { type, static_cast<uint32_t>(size) };
+
+    struct iovec iov[] = {
+        { &header, sizeof(header) },
+        { const_cast<char*>(data), size }
+    };
+
+    size_t written = 0;
+
+    // NOTE: Short writes are resumed from where they've stopped, skipping the
+    // vectors which have already been written completely.
+    while(written != sizeof(header) + size) {
+        struct iovec * it = iov;
+        size_t offset = written;
+
+        while(offset >= it->iov_len) {
+            offset -= it->iov_len;
+            ++it;
+        }
+
+        struct iovec pending[2];
+        const size_t count = iov + 2 - it;
+
+        std::copy(it, iov + 2, pending);
+
+        pending[0].iov_base = static_cast<char*>(pending[0].iov_base) + offset;
+        pending[0].iov_len -= offset;
+
+        const ssize_t result = ::writev(m_fd, pending, count);
+
+        if(result == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            // NOTE: Roll back the partially written message, so that the file
+            // stays consistent for the ones written before it.
+            if(::ftruncate(m_fd, m_size) == 0) {
+                ::lseek(m_fd, m_size, SEEK_SET);
+            }
+
+            throw cocaine::error_t("unable to spill a message - %s", ::strerror(errno));
+        }
+
+        written += result;
+    }
+
+    m_size += written;
+    m_payload += size;
+
+    m_spool.m_spilled += size;
+}
+
+namespace {
+    struct mapping_t {
+        mapping_t(int fd,
+                  size_t size_):
+            size(size_)
+        {
+            data = static_cast<const char*>(
+                ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+            );
+
+            if(data == MAP_FAILED) {
+                throw cocaine::error_t("unable to map a spill file - %s", ::strerror(errno));
+            }
+
+            ::madvise(const_cast<char*>(data), size, MADV_SEQUENTIAL);
+        }
+
+        ~mapping_t() {
+            ::munmap(const_cast<char*>(data), size);
+        }
+
+        const char * data;
+        const size_t size;
+    };
+}
+
+void
+spill_t::visit(const visitor_type& visitor) const {
+    if(!m_size) {
+        return;
+    }
+
+    const mapping_t mapping(m_fd, m_size);
+
+    size_t offset = 0;
+
+    while(offset < m_size) {
+        header_t header;
+
+        std::memcpy(&header, mapping.data + offset, sizeof(header));
+
+        offset += sizeof(header);
+
+        visitor(header.type, mapping.data + offset, header.size);
+
+        offset += header.size;
+    }
+}
@@ -0,0 +1,160 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/symbol.hpp"
+
+#include "cocaine/atomic.hpp"
+
+#include <ostream>
+
+#include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+using namespace cocaine;
+
+namespace {
+    static const size_t capacity = 4096;
+
+    // NOTE: The table is an open addressing hash table with twice as many slots
+    // as there could be symbols, so that the probe sequences are short and always
+    // end with an empty slot. The slots are only ever filled, never cleared, so
+    // the lookups don't need any locking. The insertions are serialized.
+    static const size_t slots = capacity * 2;
+
+    struct table_t {
+        table_t():
+            size(0)
+        {
+            for(size_t i = 0; i < slots; ++i) {
+                entries[i].store(NULL, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<const symbol_t::entry_t*> entries[slots];
+        std::atomic<size_t> size;
+
+        boost::mutex mutex;
+    };
+
+    table_t&
+    table() {
+        static table_t instance;
+        return instance;
+    }
+
+    // NOTE: Returns the slot which either holds the name or is empty.
+    size_t
+    probe(const table_t& table,
+          const std::string& name,
+          const symbol_t::entry_t*& entry)
+    {
+        size_t index = boost::hash<std::string>()(name) % slots;
+
+        while(true) {
+            entry = table.entries[index].load(std::memory_order_acquire);
+
+            if(entry == NULL || entry->name == name) {
+                return index;
+            }
+
+            index = (index + 1) % slots;
+        }
+    }
+
+    const symbol_t::entry_t*
+    lookup(const std::string& name) {
+        const symbol_t::entry_t * entry;
+
+        probe(table(), name, entry);
+
+        return entry;
+    }
+}
+
+const unsigned int symbol_t::dynamic;
+
+symbol_t::symbol_t(const std::string& name):
+    m_entry(lookup(name))
+{
+    if(!m_entry) {
+        m_name = name;
+    }
+}
+
+symbol_t::symbol_t(const char * name) {
+    const std::string copy(name);
+
+    m_entry = lookup(copy);
+
+    if(!m_entry) {
+        m_name = copy;
+    }
+}
+
+symbol_t::symbol_t(const entry_t * entry,
+                   const std::string& name):
+    m_entry(entry),
+    m_name(entry ? std::string() : name)
+{ }
+
+symbol_t
+symbol_t::intern(const std::string& name) {
+    table_t& table = ::table();
+
+    const entry_t * entry = lookup(name);
+
+    if(entry) {
+        return symbol_t(entry, name);
+    }
+
+    boost::unique_lock<boost::mutex> lock(table.mutex);
+
+    // NOTE: The name might have been interned while waiting for the lock.
+    const size_t index = probe(table, name, entry);
+
+    if(entry || table.size == capacity) {
+        return symbol_t(entry, name);
+    }
+
+    // NOTE: The entries live as long as the process does, the same way the
+    // table itself does.
+    entry_t * created = new entry_t();
+
+    created->name = name;
+    created->id = table.size;
+
+    table.entries[index].store(created, std::memory_order_release);
+    ++table.size;
+
+    return symbol_t(created, name);
+}
+
+size_t
+symbol_t::count() {
+    return table().size;
+}
+
+std::ostream&
+cocaine::operator<<(std::ostream& stream,
+                    const symbol_t& symbol)
+{
+    return stream << symbol.str();
+}
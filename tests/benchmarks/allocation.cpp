@@ -0,0 +1,333 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/app.hpp"
+#include "cocaine/atomic.hpp"
+#include "cocaine/context.hpp"
+#include "cocaine/session.hpp"
+#include "cocaine/slab.hpp"
+
+#include "cocaine/api/event.hpp"
+#include "cocaine/api/stream.hpp"
+
+#include <iostream>
+
+#include <boost/program_options.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace po = boost::program_options;
+
+// NOTE: Counts the global allocator calls per request, made while creating and
+// destroying the sessions the way the engine does it, first with make_shared()
+// and then with the engine slab. The sessions are kept alive in a window, as if
+// they were sitting in the queue, and the slab is warmed up with one window
+// before the measurements, so that only the steady state is counted.
+//
+// If an app is given, the whole path is measured as well: the requests with a
+// single chunk are enqueued into the running app, dispatched to its slaves and
+// replied to, with at most a window of them in flight. Every allocation made by
+// the process in the meantime is counted, in any thread, including the engine
+// thread and the bus I/O.
+
+namespace {
+    std::atomic<uint64_t> g_allocations(0);
+}
+
+void*
+operator new(size_t size) {
+    ++g_allocations;
+
+    void * ptr = std::malloc(size ? size : 1);
+
+    if(ptr == NULL) {
+        throw std::bad_alloc();
+    }
+
+    return ptr;
+}
+
+void
+operator delete(void * ptr) throw() {
+    std::free(ptr);
+}
+
+namespace {
+    double
+    now() {
+        timespec ts;
+
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    struct global_t {
+        boost::shared_ptr<session_t>
+        operator()(uint64_t id,
+                   const api::event_t& event,
+                   const boost::shared_ptr<api::stream_t>& upstream)
+        {
+            return boost::make_shared<session_t>(id, event, upstream);
+        }
+    };
+
+    struct pooled_t {
+        pooled_t():
+            slab(boost::make_shared<slab_t>())
+        { }
+
+        boost::shared_ptr<session_t>
+        operator()(uint64_t id,
+                   const api::event_t& event,
+                   const boost::shared_ptr<api::stream_t>& upstream)
+        {
+            return boost::allocate_shared<session_t>(
+                slab_allocator<session_t>(slab),
+                id,
+                event,
+                upstream
+            );
+        }
+
+        boost::shared_ptr<slab_t> slab;
+    };
+
+    template<class Factory>
+    void
+    run(const std::string& name,
+        Factory factory,
+        const std::string& type,
+        size_t requests,
+        size_t window)
+    {
+        const boost::shared_ptr<api::stream_t> upstream(boost::make_shared<api::null_stream_t>());
+        const api::event_t event(type);
+
+        std::vector<boost::shared_ptr<session_t>> sessions(window);
+
+        uint64_t id = 0;
+
+        // Warm-up.
+        for(size_t i = 0; i < window; ++i) {
+            sessions[i] = factory(id++, event, upstream);
+        }
+
+        const uint64_t allocations = g_allocations;
+        const double started = now();
+
+        for(size_t i = 0; i < requests; ++i) {
+            sessions[i % window] = factory(id++, event, upstream);
+        }
+
+        const double elapsed = now() - started;
+
+        std::cout << cocaine::format(
+            "%-8s %10llu requests, %6.02f allocations/request, %8.0f ns/request",
+            name,
+            requests,
+            static_cast<double>(g_allocations - allocations) / requests,
+            elapsed * 1e9 / requests
+        ) << std::endl;
+    }
+
+    // Counts the completed requests, so that the window could be kept.
+    struct reply_t:
+        public api::stream_t
+    {
+        reply_t():
+            completed(0)
+        { }
+
+        virtual
+        void
+        push(const char * chunk,
+             size_t size)
+        { }
+
+        virtual
+        void
+        error(error_code code,
+              const std::string& message)
+        {
+            complete();
+        }
+
+        virtual
+        void
+        close() {
+            complete();
+        }
+
+        void
+        complete() {
+            boost::unique_lock<boost::mutex> lock(mutex);
+
+            ++completed;
+
+            condition.notify_all();
+        }
+
+        void
+        wait(uint64_t target) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+
+            while(completed < target) {
+                condition.wait(lock);
+            }
+        }
+
+        boost::mutex mutex;
+        boost::condition_variable condition;
+        uint64_t completed;
+    };
+
+    // NOTE: Returns the number of the requests actually sent, as the rejected
+    // ones are never replied to.
+    uint64_t
+    send(app_t& app,
+         const boost::shared_ptr<reply_t>& upstream,
+         const api::event_t& event,
+         const std::string& payload,
+         size_t requests,
+         size_t window,
+         uint64_t sent,
+         size_t& rejected)
+    {
+        for(size_t i = 0; i < requests; ++i) {
+            if(sent >= window) {
+                upstream->wait(sent - window + 1);
+            }
+
+            try {
+                const boost::shared_ptr<api::stream_t> downstream(app.enqueue(event, upstream));
+
+                downstream->push(payload.data(), payload.size());
+                downstream->close();
+
+                ++sent;
+            } catch(const cocaine::error_t& e) {
+                ++rejected;
+            }
+        }
+
+        upstream->wait(sent);
+
+        return sent;
+    }
+
+    void
+    dispatch(app_t& app,
+             const std::string& type,
+             const std::string& payload,
+             size_t requests,
+             size_t window)
+    {
+        const boost::shared_ptr<reply_t> upstream(boost::make_shared<reply_t>());
+        const api::event_t event(type);
+
+        size_t rejected = 0;
+
+        // Warm-up.
+        uint64_t sent = send(app, upstream, event, payload, window, window, 0, rejected);
+
+        rejected = 0;
+
+        const uint64_t allocations = g_allocations;
+        const double started = now();
+
+        sent = send(app, upstream, event, payload, requests, window, sent, rejected);
+
+        const double elapsed = now() - started;
+        const size_t completed = requests - rejected;
+
+        std::cout << cocaine::format(
+            "%-8s %10llu requests, %6.02f allocations/request, %8.0f ns/request, %llu rejected",
+            "dispatch",
+            completed,
+            static_cast<double>(g_allocations - allocations) / std::max<size_t>(1, completed),
+            elapsed * 1e9 / std::max<size_t>(1, completed),
+            rejected
+        ) << std::endl;
+    }
+}
+
+int main(int argc, char * argv[]) {
+    po::options_description options("Options");
+    po::variables_map vm;
+
+    options.add_options()
+        ("help,h", "show this message")
+        ("configuration,c", po::value<std::string>(), "location of the configuration file")
+        ("app,a", po::value<std::string>(), "name of the app to dispatch the requests to")
+        ("profile,p", po::value<std::string>()->default_value("default"), "name of the app profile")
+        ("chunk,s", po::value<size_t>()->default_value(64), "request chunk size")
+        ("event,e", po::value<std::string>()->default_value("benchmark"), "event type")
+        ("requests,n", po::value<size_t>()->default_value(1048576), "number of requests per run")
+        ("window,w", po::value<size_t>()->default_value(1024), "number of sessions alive at once");
+
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(vm.count("help")) {
+        std::cout << options;
+        return EXIT_SUCCESS;
+    }
+
+    const std::string type = vm["event"].as<std::string>();
+
+    const size_t requests = vm["requests"].as<size_t>(),
+                 window = std::max<size_t>(1, vm["window"].as<size_t>());
+
+    run("global", global_t(), type, requests, window);
+    run("slab", pooled_t(), type, requests, window);
+
+    if(!vm.count("configuration") || !vm.count("app")) {
+        return EXIT_SUCCESS;
+    }
+
+    const std::string payload(vm["chunk"].as<size_t>(), 'x');
+
+    try {
+        context_t context(config_t(vm["configuration"].as<std::string>()), "core");
+        app_t app(context, vm["app"].as<std::string>(), vm["profile"].as<std::string>());
+
+        app.start();
+        dispatch(app, type, payload, requests, window);
+        app.stop();
+    } catch(const cocaine::error_t& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/app.hpp"
+#include "cocaine/context.hpp"
+
+#include "cocaine/api/event.hpp"
+#include "cocaine/api/stream.hpp"
+
+#include <iostream>
+
+#include <boost/program_options.hpp>
+
+#include <ctime>
+
+using namespace cocaine;
+
+namespace po = boost::program_options;
+
+// NOTE: Measures the driver side cost of submitting the events into a running
+// app, one by one and in batches of 1, 16 and 256 events. The app should have a
+// queue limit large enough to hold all the events of a run, otherwise the runs
+// would be measuring the rejections instead.
+
+namespace {
+    double
+    now() {
+        timespec ts;
+
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    typedef std::vector<
+        std::pair<api::event_t, boost::shared_ptr<api::stream_t>>
+    > batch_type;
+
+    void
+    report(const std::string& name,
+           size_t events,
+           size_t rejected,
+           double elapsed)
+    {
+        std::cout << cocaine::format(
+            "%-12s %10llu events, %8llu rejected, %10.0f events/s, %8.0f ns/event",
+            name,
+            events,
+            rejected,
+            events / elapsed,
+            elapsed * 1e9 / events
+        ) << std::endl;
+    }
+
+    void
+    single(app_t& app,
+           const std::string& event,
+           size_t events)
+    {
+        const boost::shared_ptr<api::stream_t> upstream(boost::make_shared<api::null_stream_t>());
+
+        size_t rejected = 0;
+
+        const double started = now();
+
+        for(size_t i = 0; i < events; ++i) {
+            try {
+                app.enqueue(api::event_t(event), upstream)->close();
+            } catch(const cocaine::error_t& e) {
+                ++rejected;
+            }
+        }
+
+        report("enqueue", events, rejected, now() - started);
+    }
+
+    void
+    batched(app_t& app,
+            const std::string& event,
+            size_t events,
+            size_t size)
+    {
+        const boost::shared_ptr<api::stream_t> upstream(boost::make_shared<api::null_stream_t>());
+
+        batch_type batch;
+
+        batch.reserve(size);
+
+        for(size_t i = 0; i < size; ++i) {
+            batch.emplace_back(api::event_t(event), upstream);
+        }
+
+        size_t rejected = 0;
+
+        const double started = now();
+
+        for(size_t i = 0; i < events / size; ++i) {
+            try {
+                std::vector<boost::shared_ptr<api::stream_t>> downstreams(app.enqueue_batch(batch));
+
+                for(size_t j = 0; j < downstreams.size(); ++j) {
+                    if(downstreams[j]) {
+                        downstreams[j]->close();
+                    } else {
+                        ++rejected;
+                    }
+                }
+            } catch(const cocaine::error_t& e) {
+                rejected += size;
+            }
+        }
+
+        report(cocaine::format("batch/%d", size), events / size * size, rejected, now() - started);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    po::options_description options("Options");
+    po::variables_map vm;
+
+    options.add_options()
+        ("help,h", "show this message")
+        ("configuration,c", po::value<std::string>(), "location of the configuration file")
+        ("app,a", po::value<std::string>(), "name of the app to benchmark")
+        ("profile,p", po::value<std::string>()->default_value("default"), "name of the app profile")
+        ("event,e", po::value<std::string>()->default_value("benchmark"), "event type")
+        ("events,n", po::value<size_t>()->default_value(65536), "number of events per run");
+
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(vm.count("help") || !vm.count("configuration") || !vm.count("app")) {
+        std::cout << options;
+        return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const std::string name = vm["app"].as<std::string>(),
+                      profile = vm["profile"].as<std::string>(),
+                      event = vm["event"].as<std::string>();
+
+    const size_t events = vm["events"].as<size_t>();
+
+    try {
+        context_t context(config_t(vm["configuration"].as<std::string>()), "core");
+
+        // NOTE: Each run gets a fresh app, so that it starts with an empty queue.
+        {
+            app_t app(context, name, profile);
+
+            app.start();
+            single(app, event, events);
+            app.stop();
+        }
+
+        const size_t sizes[] = { 1, 16, 256 };
+
+        for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            app_t app(context, name, profile);
+
+            app.start();
+            batched(app, event, events, sizes[i]);
+            app.stop();
+        }
+    } catch(const cocaine::error_t& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
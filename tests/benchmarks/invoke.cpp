@@ -0,0 +1,234 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/context.hpp"
+#include "cocaine/rpc.hpp"
+
+#include <iostream>
+
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <ctime>
+#include <unistd.h>
+
+using namespace cocaine;
+using namespace cocaine::io;
+
+namespace po = boost::program_options;
+
+// NOTE: Measures the bus cost of delivering small complete sessions to a slave,
+// either as the individual invoke, chunk and choke messages or packed into the
+// batched invocations, the way the engine does it. Both ends run in the same
+// process, connected over an ipc:// socket, same as the engine and its slaves.
+
+namespace {
+    double
+    now() {
+        timespec ts;
+
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    typedef std::vector<
+        std::pair<int, std::string>
+    > frame_list_t;
+
+    template<class Event, typename... Args>
+    void
+    frame(frame_list_t& frames,
+          Args&&... args)
+    {
+        msgpack::sbuffer buffer;
+
+        type_traits<typename event_traits<Event>::tuple_type>::pack(
+            buffer,
+            std::forward<Args>(args)...
+        );
+
+        frames.emplace_back(
+            static_cast<int>(event_traits<Event>::id),
+            std::string(buffer.data(), buffer.size())
+        );
+    }
+
+    // Counts the invocations until all the expected sessions have arrived.
+    struct receiver_t {
+        receiver_t(unique_channel_t& channel_,
+                   size_t sessions_):
+            channel(channel_),
+            sessions(sessions_)
+        { }
+
+        void
+        operator()() {
+            size_t received = 0;
+
+            while(received < sessions) {
+                int message_id = -1;
+
+                channel.recv(message_id);
+
+                zmq::message_t payload;
+
+                if(channel.more()) {
+                    channel.recv(payload);
+                }
+
+                if(message_id == event_traits<rpc::invoke>::id) {
+                    ++received;
+                } else if(message_id == event_traits<rpc::invoke_batch>::id) {
+                    msgpack::unpacked unpacked;
+                    frame_list_t frames;
+
+                    msgpack::unpack(
+                        &unpacked,
+                        static_cast<const char*>(payload.data()),
+                        payload.size()
+                    );
+
+                    type_traits<event_traits<rpc::invoke_batch>::tuple_type>::unpack(
+                        unpacked.get(),
+                        frames
+                    );
+
+                    for(frame_list_t::const_iterator it = frames.begin(); it != frames.end(); ++it) {
+                        if(it->first == event_traits<rpc::invoke>::id) {
+                            ++received;
+                        }
+                    }
+                }
+            }
+        }
+
+        unique_channel_t& channel;
+        const size_t sessions;
+    };
+
+    void
+    run(context_t& context,
+        const std::string& endpoint,
+        size_t sessions,
+        size_t batch,
+        size_t payload)
+    {
+        unique_channel_t sender(context, ZMQ_PAIR),
+                         receiver(context, ZMQ_PAIR);
+
+        receiver.bind(endpoint);
+        sender.connect(endpoint);
+
+        const std::string event("benchmark"),
+                          chunk(payload, 'x');
+
+        const double started = now();
+
+        boost::thread thread((receiver_t(receiver, sessions)));
+
+        uint64_t tag = 0;
+
+        while(tag < sessions) {
+            if(batch == 1) {
+                sender.send<rpc::invoke>(tag, event);
+                sender.send<rpc::chunk>(tag, chunk);
+                sender.send<rpc::choke>(tag);
+
+                ++tag;
+
+                continue;
+            }
+
+            frame_list_t frames;
+
+            for(size_t i = 0; i < batch && tag < sessions; ++i, ++tag) {
+                frame<rpc::invoke>(frames, tag, event);
+                frame<rpc::chunk>(frames, tag, chunk);
+                frame<rpc::choke>(frames, tag);
+            }
+
+            sender.send<rpc::invoke_batch>(frames);
+        }
+
+        thread.join();
+
+        const double elapsed = now() - started;
+
+        std::cout << cocaine::format(
+            "batch %4d, payload %6d bytes: %10.0f sessions/s, %8.0f ns/session",
+            batch,
+            payload,
+            sessions / elapsed,
+            elapsed * 1e9 / sessions
+        ) << std::endl;
+    }
+}
+
+int main(int argc, char * argv[]) {
+    po::options_description options("Options");
+    po::variables_map vm;
+
+    options.add_options()
+        ("help,h", "show this message")
+        ("configuration,c", po::value<std::string>(), "location of the configuration file")
+        ("sessions,n", po::value<size_t>()->default_value(100000), "number of sessions per run")
+        ("payload,s", po::value<size_t>()->default_value(64), "request size, in bytes");
+
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(vm.count("help") || !vm.count("configuration")) {
+        std::cout << options;
+        return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    try {
+        context_t context(config_t(vm["configuration"].as<std::string>()), "core");
+
+        const std::string endpoint = cocaine::format(
+            "ipc://%s/benchmark-invoke.%d",
+            context.config.path.runtime,
+            ::getpid()
+        );
+
+        const size_t sizes[] = { 1, 4, 16, 64 };
+
+        for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            run(
+                context,
+                endpoint,
+                vm["sessions"].as<size_t>(),
+                sizes[i],
+                vm["payload"].as<size_t>()
+            );
+        }
+    } catch(const cocaine::error_t& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
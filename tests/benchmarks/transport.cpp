@@ -0,0 +1,239 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/context.hpp"
+#include "cocaine/rpc.hpp"
+#include "cocaine/shm.hpp"
+
+#include <iostream>
+
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <ctime>
+#include <unistd.h>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+using namespace cocaine::io;
+
+namespace po = boost::program_options;
+
+// NOTE: Measures the slave to engine chunk throughput for the chunk sizes from
+// 4 KB to 16 MB, either sent over an ipc:// socket as the regular chunk messages
+// or written into a shared memory ring and announced with the chunk references,
+// the way the slaves with the "shm" feature do it. Both ends run in the same
+// process, and the receiving side handles the messages the way the engine does.
+
+namespace {
+    double
+    now() {
+        timespec ts;
+
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    struct receiver_t {
+        receiver_t(unique_channel_t& channel_,
+                   ring_t * ring_,
+                   size_t chunks_):
+            channel(channel_),
+            ring(ring_),
+            chunks(chunks_)
+        { }
+
+        void
+        operator()() {
+            std::vector<char> buffer;
+
+            for(size_t received = 0; received < chunks; ++received) {
+                int message_id = -1;
+                uint64_t tag;
+
+                channel.recv(message_id);
+
+                if(message_id == event_traits<rpc::chunk>::id) {
+                    std::string chunk;
+
+                    channel.recv<rpc::chunk>(tag, chunk);
+
+                    continue;
+                }
+
+                uint64_t size;
+
+                channel.recv<rpc::chunk_ref>(tag, size);
+
+                // NOTE: Same as slave_t::on_chunk_ref(), the chunks wrapped around
+                // the ring boundary are copied out.
+                if(!ring->front(size)) {
+                    buffer.resize(size);
+                    ring->read(&buffer[0], size);
+                }
+
+                ring->consume(size);
+            }
+        }
+
+        unique_channel_t& channel;
+        ring_t * ring;
+        const size_t chunks;
+    };
+
+    void
+    report(const std::string& name,
+           size_t size,
+           size_t chunks,
+           double elapsed)
+    {
+        std::cout << cocaine::format(
+            "%-4s %8d bytes: %8llu chunks, %10.0f chunks/s, %8.0f MB/s",
+            name,
+            size,
+            chunks,
+            chunks / elapsed,
+            chunks * size / elapsed / (1024 * 1024)
+        ) << std::endl;
+    }
+
+    void
+    ipc(context_t& context,
+        const std::string& endpoint,
+        size_t size,
+        size_t chunks)
+    {
+        unique_channel_t sender(context, ZMQ_PAIR),
+                         receiver(context, ZMQ_PAIR);
+
+        receiver.bind(endpoint);
+        sender.connect(endpoint);
+
+        const std::string chunk(size, 'x');
+
+        const double started = now();
+
+        boost::thread thread((receiver_t(receiver, NULL, chunks)));
+
+        for(uint64_t tag = 0; tag < chunks; ++tag) {
+            sender.send<rpc::chunk>(tag, chunk);
+        }
+
+        thread.join();
+
+        report("ipc", size, chunks, now() - started);
+    }
+
+    void
+    ring(context_t& context,
+         const std::string& endpoint,
+         const std::string& path,
+         size_t size,
+         size_t chunks,
+         size_t capacity)
+    {
+        unique_channel_t sender(context, ZMQ_PAIR),
+                         receiver(context, ZMQ_PAIR);
+
+        receiver.bind(endpoint);
+        sender.connect(endpoint);
+
+        shm_t shm(path, capacity);
+
+        const std::string chunk(size, 'x');
+
+        const double started = now();
+
+        boost::thread thread((receiver_t(receiver, &shm.outbound(), chunks)));
+
+        for(uint64_t tag = 0; tag < chunks; ++tag) {
+            // NOTE: The ring has no wakeups of its own, so the producer just waits
+            // for the consumer to free some space.
+            while(!shm.outbound().write(chunk.data(), chunk.size())) {
+                boost::this_thread::yield();
+            }
+
+            sender.send<rpc::chunk_ref>(tag, static_cast<uint64_t>(size));
+        }
+
+        thread.join();
+
+        report("ring", size, chunks, now() - started);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    po::options_description options("Options");
+    po::variables_map vm;
+
+    options.add_options()
+        ("help,h", "show this message")
+        ("configuration,c", po::value<std::string>(), "location of the configuration file")
+        ("volume,v", po::value<size_t>()->default_value(1024), "megabytes to transfer per run");
+
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(vm.count("help") || !vm.count("configuration")) {
+        std::cout << options;
+        return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const size_t volume = vm["volume"].as<size_t>() * 1024 * 1024;
+
+    // NOTE: The ring has to fit a couple of the largest chunks.
+    const size_t minimum = 4 * 1024,
+                 maximum = 16 * 1024 * 1024,
+                 capacity = 2 * maximum;
+
+    try {
+        context_t context(config_t(vm["configuration"].as<std::string>()), "core");
+
+        const std::string endpoint = cocaine::format(
+            "ipc://%s/benchmark-transport.%d",
+            context.config.path.runtime,
+            ::getpid()
+        );
+
+        const std::string path = cocaine::format(
+            "%s/benchmark-transport.%d.shm",
+            context.config.path.runtime,
+            ::getpid()
+        );
+
+        for(size_t size = minimum; size <= maximum; size *= 4) {
+            const size_t chunks = std::max<size_t>(volume / size, 1);
+
+            ipc(context, endpoint, size, chunks);
+            ring(context, endpoint, path, size, chunks, capacity);
+        }
+    } catch(const cocaine::error_t& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
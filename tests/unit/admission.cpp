@@ -0,0 +1,179 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/admission.hpp"
+
+#include "cocaine/api/event.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <unistd.h>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace {
+    Json::Value
+    limits(double rate,
+           double burst)
+    {
+        Json::Value args(Json::objectValue);
+
+        args["rate"] = rate;
+        args["burst"] = burst;
+
+        return args;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(admission)
+
+BOOST_AUTO_TEST_CASE(burst) {
+    token_bucket_t bucket(1.0f, 5.0f);
+
+    // NOTE: At one token per second, the burst is all there is for a while.
+    for(int i = 0; i < 5; ++i) {
+        BOOST_CHECK(bucket.consume());
+    }
+
+    BOOST_CHECK(!bucket.consume());
+
+    BOOST_CHECK_EQUAL(bucket.admitted(), 5);
+    BOOST_CHECK_EQUAL(bucket.rejected(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(replenishment) {
+    token_bucket_t bucket(100.0f, 1.0f);
+
+    BOOST_CHECK(bucket.consume());
+    BOOST_CHECK(!bucket.consume());
+
+    // NOTE: A token is replenished every 10 milliseconds.
+    ::usleep(20000);
+
+    BOOST_CHECK(bucket.consume());
+}
+
+BOOST_AUTO_TEST_CASE(refund) {
+    token_bucket_t bucket(1.0f, 1.0f);
+
+    BOOST_CHECK(bucket.consume());
+    BOOST_CHECK(!bucket.consume());
+
+    bucket.refund();
+
+    BOOST_CHECK(bucket.consume());
+    BOOST_CHECK_EQUAL(bucket.admitted(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(refund_when_idle) {
+    token_bucket_t bucket(100.0f, 2.0f);
+
+    BOOST_CHECK(bucket.consume());
+    BOOST_CHECK(bucket.consume());
+
+    // NOTE: The bucket is full again by now, so the refunds must not add to it.
+    ::usleep(50000);
+
+    bucket.refund();
+    bucket.refund();
+
+    BOOST_CHECK(bucket.consume());
+    BOOST_CHECK(bucket.consume());
+    BOOST_CHECK(!bucket.consume());
+}
+
+BOOST_AUTO_TEST_CASE(invalid_limits) {
+    Json::Value args(Json::objectValue);
+
+    args["drivers"]["http"] = limits(0.0f, 1.0f);
+
+    BOOST_CHECK_THROW(admission_t admission(args), configuration_error_t);
+
+    args["drivers"]["http"] = limits(1.0f, 0.5f);
+
+    BOOST_CHECK_THROW(admission_t admission(args), configuration_error_t);
+}
+
+BOOST_AUTO_TEST_CASE(drivers) {
+    Json::Value args(Json::objectValue);
+
+    args["drivers"]["http"] = limits(1.0f, 2.0f);
+
+    admission_t admission(args);
+
+    const api::event_t http("event", api::policy_t(), "http"),
+                       other("event", api::policy_t(), "zmq");
+
+    BOOST_CHECK(admission.admit(http));
+    BOOST_CHECK(admission.admit(http));
+    BOOST_CHECK(!admission.admit(http));
+
+    // NOTE: Drivers without a configured bucket are not limited.
+    for(int i = 0; i < 10; ++i) {
+        BOOST_CHECK(admission.admit(other));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(client_rejection_keeps_driver_tokens) {
+    Json::Value args(Json::objectValue);
+
+    args["drivers"]["http"] = limits(1.0f, 2.0f);
+    args["clients"] = limits(1.0f, 1.0f);
+    args["clients"]["slots"] = 1;
+
+    admission_t admission(args);
+
+    const api::event_t noisy("event", api::policy_t(), "http", "noisy");
+
+    BOOST_CHECK(admission.admit(noisy));
+
+    // NOTE: These are rejected by the client bucket, and must not drain the
+    // driver bucket for everyone else.
+    for(int i = 0; i < 10; ++i) {
+        BOOST_CHECK(!admission.admit(noisy));
+    }
+
+    BOOST_CHECK(admission.admit(api::event_t("event", api::policy_t(), "http")));
+
+    const Json::Value info(admission.info());
+
+    BOOST_CHECK_EQUAL(info["drivers"]["http"]["admitted"].asUInt(), 2);
+    BOOST_CHECK_EQUAL(info["clients"]["rejected"].asUInt(), 10);
+}
+
+BOOST_AUTO_TEST_CASE(refund_event) {
+    Json::Value args(Json::objectValue);
+
+    args["drivers"]["http"] = limits(1.0f, 1.0f);
+
+    admission_t admission(args);
+
+    const api::event_t http("event", api::policy_t(), "http");
+
+    BOOST_CHECK(admission.admit(http));
+    BOOST_CHECK(!admission.admit(http));
+
+    admission.refund(http);
+
+    BOOST_CHECK(admission.admit(http));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
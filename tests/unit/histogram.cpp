@@ -0,0 +1,107 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/histogram.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace {
+    // NOTE: Records the value along with a much larger one, so that the median
+    // is the midpoint of the value's bucket and is not clamped to the maximum.
+    double
+    median(uint64_t microseconds) {
+        histogram_t histogram;
+
+        histogram.record(microseconds * 1000);
+        histogram.record(1000000000000LL);
+
+        return histogram.percentile(0.5f) * 1e6;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(histogram)
+
+BOOST_AUTO_TEST_CASE(empty) {
+    histogram_t histogram;
+
+    BOOST_CHECK_EQUAL(histogram.count(), 0);
+    BOOST_CHECK_EQUAL(histogram.percentile(0.5f), 0.0f);
+}
+
+BOOST_AUTO_TEST_CASE(exact_values) {
+    histogram_t histogram;
+
+    // NOTE: The values below 2^precision have their own buckets.
+    for(int i = 1; i <= 7; ++i) {
+        histogram.record(i * 1000);
+    }
+
+    BOOST_CHECK_EQUAL(histogram.count(), 7);
+    BOOST_CHECK_CLOSE(histogram.percentile(0.5f), 4e-6, 1e-6);
+    BOOST_CHECK_CLOSE(histogram.percentile(1.0f), 7e-6, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(relative_error) {
+    double previous = 0.0f;
+
+    for(uint64_t value = 1; value < (1ULL << 30); value = value * 5 / 4 + 1) {
+        const double estimate = median(value);
+
+        BOOST_CHECK_LE(std::fabs(estimate - value) / value, 1.0f / 8);
+
+        // NOTE: The bucket midpoints are ordered like the values.
+        BOOST_CHECK_GE(estimate, previous);
+
+        previous = estimate;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bucket_boundaries) {
+    for(unsigned int exponent = 3; exponent < 30; ++exponent) {
+        const uint64_t lower = 1ULL << exponent;
+
+        // NOTE: The last value of a power of two and the first value of the next
+        // one fall into the adjacent buckets.
+        BOOST_CHECK_LT(median(lower - 1), median(lower));
+        BOOST_CHECK_LE(std::fabs(median(lower) - lower) / lower, 1.0f / 8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(out_of_range) {
+    histogram_t histogram;
+
+    // NOTE: Negative and sub-microsecond durations are counted as zeroes, the
+    // huge ones are clamped to the largest tracked value.
+    histogram.record(-1000);
+    histogram.record(999);
+    histogram.record(1LL << 62);
+
+    BOOST_CHECK_EQUAL(histogram.count(), 3);
+    BOOST_CHECK_EQUAL(histogram.percentile(0.5f), 0.0f);
+    BOOST_CHECK_CLOSE(histogram.info()["max"].asDouble(), ((1ULL << 40) - 1) / 1e6, 1e-6);
+    BOOST_CHECK_CLOSE(histogram.percentile(1.0f), ((1ULL << 40) - 1) / 1e6, 100.0f / 8);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/pool_arbiter.hpp"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace cocaine::engine;
+
+BOOST_AUTO_TEST_SUITE(pool_arbiter)
+
+BOOST_AUTO_TEST_CASE(unlimited) {
+    pool_arbiter_t arbiter(0, 0);
+
+    BOOST_CHECK(!arbiter.enabled());
+    BOOST_CHECK_EQUAL(arbiter.update("a", 1.0f, 10, 0, 0), std::numeric_limits<size_t>::max());
+}
+
+BOOST_AUTO_TEST_CASE(demand_below_limit) {
+    pool_arbiter_t arbiter(10, 0);
+
+    arbiter.update("a", 1.0f, 2, 0, 0);
+
+    BOOST_CHECK_EQUAL(arbiter.update("b", 1.0f, 3, 0, 0), 3);
+    BOOST_CHECK_EQUAL(arbiter.update("a", 1.0f, 2, 0, 0), 2);
+}
+
+BOOST_AUTO_TEST_CASE(water_filling) {
+    pool_arbiter_t arbiter(10, 0);
+
+    // NOTE: The quiet app gets all it needs, the rest is split evenly between
+    // the busy ones.
+    arbiter.update("quiet", 1.0f, 2, 0, 0);
+    arbiter.update("busy-1", 1.0f, 100, 0, 0);
+
+    BOOST_CHECK_EQUAL(arbiter.update("busy-2", 1.0f, 100, 0, 0), 4);
+    BOOST_CHECK_EQUAL(arbiter.update("busy-1", 1.0f, 100, 0, 0), 4);
+    BOOST_CHECK_EQUAL(arbiter.update("quiet", 1.0f, 2, 0, 0), 2);
+}
+
+BOOST_AUTO_TEST_CASE(weights) {
+    pool_arbiter_t arbiter(12, 0);
+
+    arbiter.update("heavy", 3.0f, 100, 0, 0);
+
+    BOOST_CHECK_EQUAL(arbiter.update("light", 1.0f, 100, 0, 0), 3);
+    BOOST_CHECK_EQUAL(arbiter.update("heavy", 3.0f, 100, 0, 0), 9);
+}
+
+BOOST_AUTO_TEST_CASE(whole_capacity) {
+    pool_arbiter_t arbiter(10, 0);
+
+    arbiter.update("a", 1.0f, 100, 0, 0);
+    arbiter.update("b", 1.0f, 100, 0, 0);
+
+    // NOTE: Three equal shares of 3.33 slaves, the one lost to the rounding is
+    // still handed out.
+    const size_t total = arbiter.update("c", 1.0f, 100, 0, 0) +
+                         arbiter.update("a", 1.0f, 100, 0, 0) +
+                         arbiter.update("b", 1.0f, 100, 0, 0);
+
+    BOOST_CHECK_EQUAL(total, 10);
+}
+
+BOOST_AUTO_TEST_CASE(no_starvation) {
+    pool_arbiter_t arbiter(3, 0);
+
+    const char * names[] = { "a", "b", "c", "d" };
+
+    // NOTE: Four equal apps with a single slave of demand each, and only three
+    // slaves to go around. No app should be left out on every rebalance.
+    std::map<std::string, size_t> granted;
+
+    for(int i = 0; i < 4; ++i) {
+        arbiter.update(names[i], 1.0f, 1, 0, 0);
+    }
+
+    for(int round = 0; round < 8; ++round) {
+        for(int i = 0; i < 4; ++i) {
+            if(arbiter.update(names[i], 1.0f, 1, 0, 0) > 0) {
+                ++granted[names[i]];
+            }
+        }
+    }
+
+    for(int i = 0; i < 4; ++i) {
+        BOOST_CHECK_MESSAGE(granted[names[i]] > 0, "app '" << names[i] << "' has been starved");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(empty_pool_first) {
+    pool_arbiter_t arbiter(3, 0);
+
+    // NOTE: Three apps already hold the whole capacity, a new one with an empty
+    // pool still gets a slave.
+    arbiter.update("a", 1.0f, 1, 1, 0);
+    arbiter.update("b", 1.0f, 1, 1, 0);
+    arbiter.update("c", 1.0f, 1, 1, 0);
+
+    BOOST_CHECK_EQUAL(arbiter.update("d", 1.0f, 1, 0, 0), 1);
+}
+
+BOOST_AUTO_TEST_CASE(donation) {
+    pool_arbiter_t arbiter(4, 0);
+
+    // NOTE: A negligible weight still guarantees a slave for an empty pool, taken
+    // from the app with the largest share.
+    arbiter.update("big", 1000.0f, 100, 4, 0);
+
+    BOOST_CHECK_EQUAL(arbiter.update("small", 0.001f, 1, 0, 0), 1);
+    BOOST_CHECK_EQUAL(arbiter.update("big", 1000.0f, 100, 4, 0), 3);
+}
+
+BOOST_AUTO_TEST_CASE(idle_slaves_kept) {
+    pool_arbiter_t arbiter(10, 0);
+
+    // NOTE: Spare capacity lets the quiet app keep its idle slaves.
+    arbiter.update("busy", 1.0f, 4, 4, 0);
+
+    BOOST_CHECK_EQUAL(arbiter.update("quiet", 1.0f, 0, 3, 0), 3);
+}
+
+BOOST_AUTO_TEST_CASE(memory_limit) {
+    pool_arbiter_t arbiter(0, 1024);
+
+    // NOTE: Over the memory limit, the apps can only trade the existing slaves.
+    arbiter.update("a", 1.0f, 10, 2, 1024);
+
+    BOOST_CHECK_EQUAL(arbiter.update("a", 1.0f, 10, 2, 1024), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
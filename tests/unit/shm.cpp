@@ -0,0 +1,169 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/shm.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace {
+    // NOTE: A ring in the regular memory, aligned the same way as in the shared
+    // memory file.
+    struct region_t {
+        region_t(size_t capacity):
+            base(NULL)
+        {
+            BOOST_REQUIRE(::posix_memalign(&base, 64, sizeof(ring_t::header_t) + capacity) == 0);
+        }
+
+        ~region_t() {
+            std::free(base);
+        }
+
+        ring_t::header_t&
+        header() {
+            return *static_cast<ring_t::header_t*>(base);
+        }
+
+        void * base;
+    };
+
+    std::string
+    pattern(size_t size,
+            char seed)
+    {
+        std::string result(size, '\0');
+
+        for(size_t i = 0; i < size; ++i) {
+            result[i] = seed + i % 23;
+        }
+
+        return result;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(shm)
+
+BOOST_AUTO_TEST_CASE(contiguous) {
+    region_t region(64);
+    ring_t ring(region.base, 64);
+
+    const std::string chunk(pattern(40, 'a'));
+
+    BOOST_CHECK_EQUAL(region.header().magic, ring_t::magic);
+    BOOST_REQUIRE(ring.write(chunk.data(), chunk.size()));
+
+    const char * data = ring.front(chunk.size());
+
+    BOOST_REQUIRE(data != NULL);
+    BOOST_CHECK(std::string(data, chunk.size()) == chunk);
+
+    ring.consume(chunk.size());
+
+    BOOST_CHECK_EQUAL(region.header().head.load(), 40);
+}
+
+BOOST_AUTO_TEST_CASE(wrap_around) {
+    region_t region(64);
+    ring_t ring(region.base, 64);
+
+    // NOTE: Moves both positions close to the end of the ring, so that the next
+    // chunk is split between the end and the beginning.
+    const std::string filler(pattern(50, 'a')),
+                      chunk(pattern(30, 'k'));
+
+    BOOST_REQUIRE(ring.write(filler.data(), filler.size()));
+
+    ring.consume(filler.size());
+
+    BOOST_REQUIRE(ring.write(chunk.data(), chunk.size()));
+
+    BOOST_CHECK(ring.front(chunk.size()) == NULL);
+
+    std::string buffer(chunk.size(), '\0');
+
+    ring.read(&buffer[0], buffer.size());
+
+    BOOST_CHECK(buffer == chunk);
+
+    ring.consume(chunk.size());
+
+    // NOTE: The positions keep growing past the capacity.
+    BOOST_CHECK_EQUAL(region.header().head.load(), 80);
+    BOOST_CHECK_EQUAL(region.header().tail.load(), 80);
+
+    BOOST_REQUIRE(ring.write(chunk.data(), chunk.size()));
+    BOOST_REQUIRE(ring.front(chunk.size()) != NULL);
+    BOOST_CHECK(std::string(ring.front(chunk.size()), chunk.size()) == chunk);
+}
+
+BOOST_AUTO_TEST_CASE(full) {
+    region_t region(64);
+    ring_t ring(region.base, 64);
+
+    const std::string chunk(pattern(40, 'a'));
+
+    BOOST_REQUIRE(ring.write(chunk.data(), chunk.size()));
+    BOOST_CHECK(!ring.write(chunk.data(), chunk.size()));
+    BOOST_CHECK(!ring.write(chunk.data(), 65));
+
+    // NOTE: Nothing is written if there's not enough space.
+    BOOST_CHECK_EQUAL(region.header().tail.load(), 40);
+
+    ring.consume(chunk.size());
+
+    BOOST_CHECK(ring.write(chunk.data(), chunk.size()));
+}
+
+BOOST_AUTO_TEST_CASE(out_of_sync) {
+    region_t region(64);
+    ring_t ring(region.base, 64);
+
+    const std::string chunk(pattern(40, 'a'));
+
+    BOOST_REQUIRE(ring.write(chunk.data(), chunk.size()));
+
+    // NOTE: More than the producer has written.
+    BOOST_CHECK_THROW(ring.front(41), cocaine::error_t);
+
+    // NOTE: A tail position too far ahead, as if the peer has corrupted it,
+    // doesn't make the oversized announcements acceptable.
+    region.header().tail = 1024;
+
+    BOOST_CHECK_THROW(ring.front(512), cocaine::error_t);
+    BOOST_CHECK_THROW(ring.front(40), cocaine::error_t);
+
+    std::string buffer(512, '\0');
+
+    BOOST_CHECK_THROW(ring.read(&buffer[0], buffer.size()), cocaine::error_t);
+    BOOST_CHECK_THROW(ring.write(chunk.data(), chunk.size()), cocaine::error_t);
+
+    // NOTE: A head position ahead of the tail.
+    region.header().tail = 40;
+    region.header().head = 80;
+
+    BOOST_CHECK_THROW(ring.front(1), cocaine::error_t);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/slab.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+BOOST_AUTO_TEST_SUITE(slab)
+
+BOOST_AUTO_TEST_CASE(fresh_blocks) {
+    slab_t slab;
+
+    std::vector<void*> blocks;
+
+    // NOTE: Enough blocks to span a couple of chunks.
+    for(int i = 0; i < 2048; ++i) {
+        blocks.push_back(slab.allocate(64));
+    }
+
+    std::sort(blocks.begin(), blocks.end());
+
+    BOOST_CHECK(std::unique(blocks.begin(), blocks.end()) == blocks.end());
+
+    const Json::Value info = slab.info();
+
+    BOOST_CHECK_EQUAL(info["allocated"].asUInt(), 2048);
+    BOOST_CHECK_EQUAL(info["recycled"].asUInt(), 0);
+    BOOST_CHECK_EQUAL(info["chunks"].asUInt(), 2);
+
+    for(std::vector<void*>::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        slab.deallocate(*it, 64);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(recycled_blocks) {
+    slab_t slab;
+
+    void * block = slab.allocate(100);
+
+    slab.deallocate(block, 100);
+
+    // NOTE: The same size class gets the returned block back.
+    BOOST_CHECK_EQUAL(slab.allocate(128), block);
+    BOOST_CHECK(slab.allocate(128) != block);
+
+    const Json::Value info = slab.info();
+
+    BOOST_CHECK_EQUAL(info["allocated"].asUInt(), 3);
+    BOOST_CHECK_EQUAL(info["recycled"].asUInt(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(oversized_blocks) {
+    slab_t slab;
+
+    void * block = slab.allocate(4096);
+
+    slab.deallocate(block, 4096);
+
+    const Json::Value info = slab.info();
+
+    BOOST_CHECK_EQUAL(info["oversized"].asUInt(), 1);
+    BOOST_CHECK_EQUAL(info["recycled"].asUInt(), 0);
+    BOOST_CHECK_EQUAL(info["chunks"].asUInt(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,123 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/spool.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace {
+    typedef std::vector<
+        std::pair<int, std::string>
+    > message_list_t;
+
+    void
+    collect(message_list_t& messages,
+            int type,
+            const char * data,
+            size_t size)
+    {
+        messages.emplace_back(type, std::string(data, size));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(spool)
+
+BOOST_AUTO_TEST_CASE(budget) {
+    spool_t spool("/tmp", 100);
+
+    BOOST_CHECK(spool.reserve(60));
+    BOOST_CHECK(!spool.reserve(60));
+    BOOST_CHECK(spool.reserve(40));
+
+    spool.release(60);
+
+    BOOST_CHECK(spool.reserve(60));
+
+    // NOTE: A lowered budget applies to the new reservations only.
+    spool.resize(50);
+
+    BOOST_CHECK(!spool.reserve(1));
+}
+
+BOOST_AUTO_TEST_CASE(append_visit) {
+    spool_t spool("/tmp", 0);
+    spill_t spill(spool);
+
+    message_list_t expected;
+
+    expected.emplace_back(1, "first");
+    expected.emplace_back(2, std::string());
+    expected.emplace_back(3, std::string(1024 * 1024, 'x'));
+    expected.emplace_back(4, "last");
+
+    for(message_list_t::const_iterator it = expected.begin(); it != expected.end(); ++it) {
+        spill.append(it->first, it->second.data(), it->second.size());
+    }
+
+    BOOST_CHECK_EQUAL(spill.size(), 5 + 1024 * 1024 + 4);
+
+    message_list_t messages;
+
+    spill.visit(boost::bind(&collect, boost::ref(messages), _1, _2, _3));
+
+    BOOST_REQUIRE_EQUAL(messages.size(), expected.size());
+
+    for(size_t i = 0; i < expected.size(); ++i) {
+        BOOST_CHECK_EQUAL(messages[i].first, expected[i].first);
+        BOOST_CHECK(messages[i].second == expected[i].second);
+    }
+
+    // NOTE: The file is still appendable after it has been visited.
+    spill.append(5, "more", 4);
+
+    messages.clear();
+
+    spill.visit(boost::bind(&collect, boost::ref(messages), _1, _2, _3));
+
+    BOOST_REQUIRE_EQUAL(messages.size(), expected.size() + 1);
+    BOOST_CHECK_EQUAL(messages.back().first, 5);
+    BOOST_CHECK_EQUAL(messages.back().second, "more");
+
+    BOOST_CHECK_EQUAL(spool.info()["spilled"].asUInt(), spill.size());
+}
+
+BOOST_AUTO_TEST_CASE(empty_visit) {
+    spool_t spool("/tmp", 0);
+    spill_t spill(spool);
+
+    message_list_t messages;
+
+    spill.visit(boost::bind(&collect, boost::ref(messages), _1, _2, _3));
+
+    BOOST_CHECK(messages.empty());
+    BOOST_CHECK_EQUAL(spill.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_path) {
+    spool_t spool("/nonexistent/spool", 0);
+
+    BOOST_CHECK_THROW(spool.open(), cocaine::error_t);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,76 @@
+/*
+    Copyright (c) 2011-2012 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/symbol.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace cocaine;
+
+BOOST_AUTO_TEST_SUITE(symbol)
+
+BOOST_AUTO_TEST_CASE(lookup_only) {
+    const size_t count = symbol_t::count();
+
+    // NOTE: Constructing a symbol never adds its name to the table.
+    const symbol_t event("symbol/lookup-only");
+
+    BOOST_CHECK(!event.interned());
+    BOOST_CHECK_EQUAL(event.id(), symbol_t::dynamic);
+    BOOST_CHECK_EQUAL(event.str(), "symbol/lookup-only");
+    BOOST_CHECK_EQUAL(symbol_t::count(), count);
+}
+
+BOOST_AUTO_TEST_CASE(interning) {
+    const size_t count = symbol_t::count();
+
+    const symbol_t dynamic("symbol/interning");
+    const symbol_t interned(symbol_t::intern("symbol/interning"));
+
+    BOOST_CHECK(interned.interned());
+    BOOST_CHECK_EQUAL(interned.id(), count);
+    BOOST_CHECK_EQUAL(symbol_t::count(), count + 1);
+
+    // NOTE: Interning the same name again yields the same entry.
+    BOOST_CHECK_EQUAL(symbol_t::intern("symbol/interning").id(), interned.id());
+    BOOST_CHECK_EQUAL(symbol_t::count(), count + 1);
+
+    // NOTE: The symbols constructed afterwards pick the entry up.
+    const symbol_t event(std::string("symbol/interning"));
+
+    BOOST_CHECK(event.interned());
+    BOOST_CHECK_EQUAL(event.id(), interned.id());
+
+    BOOST_CHECK(event == interned);
+    BOOST_CHECK(dynamic == interned);
+    BOOST_CHECK(dynamic != symbol_t("symbol/other"));
+}
+
+BOOST_AUTO_TEST_CASE(distinct_ids) {
+    const symbol_t first(symbol_t::intern("symbol/first")),
+                   second(symbol_t::intern("symbol/second"));
+
+    BOOST_CHECK(first.id() != second.id());
+    BOOST_CHECK(first != second);
+    BOOST_CHECK_EQUAL(first.str(), "symbol/first");
+    BOOST_CHECK_EQUAL(second.str(), "symbol/second");
+}
+
+BOOST_AUTO_TEST_SUITE_END()